@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ez_tracer.h>
+
+/*
+ * Microbenchmarks for the ez_tracer.h primitives, run with `make bench`.
+ *
+ * Scalar timings call the primitive once per iteration and force the result
+ * out to memory, so they measure the cost of one isolated call the way
+ * traceRay makes them. Batched timings run it over arrays of BENCH_COUNT
+ * vectors and only publish the output array at the end, leaving the compiler
+ * free to unroll and vectorize. Each figure is the best of BENCH_REPEATS runs
+ * of at least BENCH_MIN_SECONDS. An optional argument runs only the
+ * benchmarks whose name contains it.
+ */
+#define BENCH_COUNT 4096
+#define BENCH_REPEATS 7
+#define BENCH_MIN_SECONDS 0.05
+
+/* Makes the compiler assume the pointed to memory is read and written, so the work feeding it stays. */
+#define escape(pointer) __asm__ volatile("" : : "g"(pointer) : "memory")
+
+typedef double (*bench_fn)(long batches);
+
+typedef struct {
+    const char *name;
+    bench_fn scalar;
+    bench_fn batched;
+} bench_t;
+
+Vec3 inputA[BENCH_COUNT];
+Vec3 inputB[BENCH_COUNT];
+float inputScalar[BENCH_COUNT];
+ray inputRay[BENCH_COUNT];
+Vec3 outputVec3[BENCH_COUNT];
+float outputFloat[BENCH_COUNT];
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+float randomUnit() {
+    return 2.0f * rand() / RAND_MAX - 1.0f;
+}
+
+Vec3 randomVec3() {
+    Vec3 v;
+    do {
+        v = (Vec3){randomUnit(), randomUnit(), randomUnit()};
+    } while (squared(&v) < 1e-4f);
+    return v;
+}
+
+void fillInputs() {
+    srand(1);
+    for (int i = 0; i < BENCH_COUNT; i++) {
+        inputA[i] = randomVec3();
+        inputB[i] = randomVec3();
+        inputScalar[i] = randomUnit() * 100;
+        inputRay[i] = (ray){randomVec3(), randomVec3(), inputScalar[i]};
+    }
+}
+
+#define BENCH(name, type, output, expr)                         \
+    double name##Scalar(long batches) {                         \
+        double start = now();                                   \
+        for (long n = 0; n < batches; n++) {                    \
+            for (int i = 0; i < BENCH_COUNT; i++) {             \
+                type result = expr;                             \
+                escape(&result);                                \
+            }                                                   \
+        }                                                       \
+        return now() - start;                                   \
+    }                                                           \
+    double name##Batched(long batches) {                        \
+        double start = now();                                   \
+        for (long n = 0; n < batches; n++) {                    \
+            escape(inputA);                                     \
+            for (int i = 0; i < BENCH_COUNT; i++) {             \
+                output[i] = expr;                               \
+            }                                                   \
+            escape(output);                                     \
+        }                                                       \
+        return now() - start;                                   \
+    }
+
+BENCH(add, Vec3, outputVec3, add(&inputA[i], &inputB[i]))
+BENCH(sub, Vec3, outputVec3, sub(&inputA[i], &inputB[i]))
+BENCH(dot, float, outputFloat, dot(&inputA[i], &inputB[i]))
+BENCH(magnitude, float, outputFloat, magnitude(&inputA[i]))
+BENCH(cosAngle, float, outputFloat, cos_angle(&inputA[i], &inputB[i]))
+BENCH(rayPoint, Vec3, outputVec3, get_ray_vec3(&inputRay[i]))
+BENCH(constantMultiply, Vec3, outputVec3, constant_multiply(&inputA[i], inputScalar[i]))
+
+/* Nanoseconds per call: the best of several runs, each long enough to swamp timer overhead. */
+double measure(bench_fn fn) {
+    long batches = 1;
+    double best = 0;
+
+    while (fn(batches) < BENCH_MIN_SECONDS) batches *= 2;
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        double seconds = fn(batches);
+        if (r == 0 || seconds < best) best = seconds;
+    }
+    return best * 1e9 / ((double)batches * BENCH_COUNT);
+}
+
+int main(int argc, char **argv) {
+    bench_t benches[] = {
+        {"add", addScalar, addBatched},
+        {"sub", subScalar, subBatched},
+        {"dot", dotScalar, dotBatched},
+        {"magnitude", magnitudeScalar, magnitudeBatched},
+        {"cos_angle", cosAngleScalar, cosAngleBatched},
+        {"get_ray_vec3", rayPointScalar, rayPointBatched},
+        {"constant_multiply", constantMultiplyScalar, constantMultiplyBatched},
+    };
+    const char *filter = argc > 1 ? argv[1] : NULL;
+
+    fillInputs();
+    printf("%-18s %14s %14s\n", "primitive", "scalar ns/op", "batched ns/op");
+    for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+        if (filter != NULL && strstr(benches[b].name, filter) == NULL) continue;
+        printf("%-18s %14.3f %14.3f\n", benches[b].name, measure(benches[b].scalar), measure(benches[b].batched));
+        fflush(stdout);
+    }
+    return 0;
+}
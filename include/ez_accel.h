@@ -0,0 +1,102 @@
+#ifndef EZ_ACCEL_H
+#define EZ_ACCEL_H
+
+#include <string.h>
+#include <math.h>
+#include <ez_tracer.h>
+#include <ez_cluster.h>
+
+/*
+ * Quality metrics for the acceleration structure: a root holding the
+ * in-core spheres, tested by every ray, plus one leaf per cluster, whose
+ * bounds are tested by every ray and whose spheres are tested when the ray
+ * enters its box.
+ *
+ * The SAH cost is the expected number of box and sphere tests for a ray that
+ * hits the scene bounds, taking the chance of entering a leaf as its surface
+ * area over the root's. leafHits is the expected number of leaves entered.
+ * overlap adds up the surface area of every pairwise leaf intersection over
+ * the root's, roughly the leaves a ray enters only because boxes overlap;
+ * well clustered scenes keep it well below leafHits. The histogram counts
+ * leaves by size in powers of two: bin 0 holds empty leaves and bin b sizes
+ * from 2^(b-1) up to 2^b - 1.
+ */
+#define ACCEL_TRAVERSAL_COST 1.0
+#define ACCEL_INTERSECT_COST 1.0
+#define ACCEL_HISTOGRAM_BINS 24
+
+typedef struct {
+    int leaves;
+    int rootSpheres;
+    unsigned long long leafSpheres;
+    unsigned int leafMin;
+    unsigned int leafMax;
+    double sah;
+    double leafHits;
+    double overlap;
+    int histogram[ACCEL_HISTOGRAM_BINS];
+} accel_metrics_t;
+
+double accel_area(Vec3 min, Vec3 max) {
+    double dx = max.x - min.x;
+    double dy = max.y - min.y;
+    double dz = max.z - min.z;
+
+    if (dx < 0 || dy < 0 || dz < 0) return 0;
+    return 2 * (dx * dy + dy * dz + dz * dx);
+}
+
+int accel_histogram_bin(unsigned int count) {
+    int bin = 0;
+
+    while (count > 0 && bin < ACCEL_HISTOGRAM_BINS - 1) {
+        count >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+void accel_measure(accel_metrics_t *metrics, int rootSpheres, const cluster_t *clusters, int count) {
+    Vec3 min = {0, 0, 0};
+    Vec3 max = {0, 0, 0};
+    double rootArea;
+
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->leaves = count;
+    metrics->rootSpheres = rootSpheres;
+    metrics->sah = rootSpheres * ACCEL_INTERSECT_COST + count * ACCEL_TRAVERSAL_COST;
+    if (count == 0) return;
+
+    min = clusters[0].min;
+    max = clusters[0].max;
+    metrics->leafMin = clusters[0].count;
+    for (int c = 0; c < count; c++) {
+        const cluster_t *cluster = &clusters[c];
+        min = (Vec3){fminf(min.x, cluster->min.x), fminf(min.y, cluster->min.y), fminf(min.z, cluster->min.z)};
+        max = (Vec3){fmaxf(max.x, cluster->max.x), fmaxf(max.y, cluster->max.y), fmaxf(max.z, cluster->max.z)};
+        metrics->leafSpheres += cluster->count;
+        if (cluster->count < metrics->leafMin) metrics->leafMin = cluster->count;
+        if (cluster->count > metrics->leafMax) metrics->leafMax = cluster->count;
+        metrics->histogram[accel_histogram_bin(cluster->count)]++;
+    }
+
+    rootArea = accel_area(min, max);
+    if (rootArea <= 0) return;
+    for (int a = 0; a < count; a++) {
+        const cluster_t *first = &clusters[a];
+        double share = accel_area(first->min, first->max) / rootArea;
+
+        metrics->leafHits += share;
+        metrics->sah += share * first->count * ACCEL_INTERSECT_COST;
+        for (int b = a + 1; b < count; b++) {
+            const cluster_t *second = &clusters[b];
+            Vec3 lo = {fmaxf(first->min.x, second->min.x), fmaxf(first->min.y, second->min.y),
+                       fmaxf(first->min.z, second->min.z)};
+            Vec3 hi = {fminf(first->max.x, second->max.x), fminf(first->max.y, second->max.y),
+                       fminf(first->max.z, second->max.z)};
+            metrics->overlap += accel_area(lo, hi) / rootArea;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef EZ_ADAPTIVE_H
+#define EZ_ADAPTIVE_H
+
+#include <math.h>
+#include <stdlib.h>
+
+#define ADAPTIVE_MAX_TILE_SIZE 256
+
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+    int active;
+    float error;
+} tile_t;
+
+typedef struct {
+    int tileSize;
+    int columns;
+    int rows;
+    int count;
+    tile_t *tiles;
+} tile_grid_t;
+
+typedef struct {
+    int minSamples;
+    int maxSamples;
+    int samplesPerPass;
+    float threshold;
+} adaptive_settings_t;
+
+int tiles_create(tile_grid_t *grid, int width, int height, int tileSize) {
+    if (tileSize < 1) tileSize = 1;
+    if (tileSize > ADAPTIVE_MAX_TILE_SIZE) tileSize = ADAPTIVE_MAX_TILE_SIZE;
+
+    grid->tileSize = tileSize;
+    grid->columns = (width + tileSize - 1) / tileSize;
+    grid->rows = (height + tileSize - 1) / tileSize;
+    grid->count = grid->columns * grid->rows;
+    grid->tiles = calloc(grid->count, sizeof(tile_t));
+    if (grid->tiles == NULL) return -1;
+
+    for (int i = 0; i < grid->count; i++) {
+        tile_t *tile = &grid->tiles[i];
+        tile->x = (i % grid->columns) * tileSize;
+        tile->y = (i / grid->columns) * tileSize;
+        tile->width = width - tile->x < tileSize ? width - tile->x : tileSize;
+        tile->height = height - tile->y < tileSize ? height - tile->y : tileSize;
+        tile->active = 1;
+        tile->error = INFINITY;
+    }
+    return 0;
+}
+
+/* Restarts sampling on every tile, as after tiles_create. */
+void tiles_reset(tile_grid_t *grid) {
+    for (int i = 0; i < grid->count; i++) {
+        grid->tiles[i].active = 1;
+        grid->tiles[i].error = INFINITY;
+    }
+}
+
+/* Wakes converged tiles without resetting their error, e.g. after the sample limit was raised. */
+void tiles_activate(tile_grid_t *grid) {
+    for (int i = 0; i < grid->count; i++) {
+        grid->tiles[i].active = 1;
+    }
+}
+
+void tiles_destroy(tile_grid_t *grid) {
+    free(grid->tiles);
+    grid->tiles = NULL;
+    grid->count = 0;
+}
+
+int tiles_active(tile_grid_t *grid) {
+    int active = 0;
+    for (int i = 0; i < grid->count; i++) {
+        active += grid->tiles[i].active;
+    }
+    return active;
+}
+
+float luminance(float r, float g, float b) {
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+/*
+ * Relative standard error of the pixel mean. Dark pixels are measured against
+ * a floor of 0.1 so that noise nobody can see does not keep a tile alive.
+ */
+float adaptive_pixel_error(float mean, float variance, unsigned int samples) {
+    if (samples < 2) return INFINITY;
+    return sqrtf(variance / samples) / fmaxf(mean, 0.1f);
+}
+
+int adaptive_samples_needed(adaptive_settings_t *settings, float mean, float variance, unsigned int samples) {
+    int remaining = settings->maxSamples - (int)samples;
+    if (remaining <= 0) return 0;
+    if ((int)samples >= settings->minSamples && settings->threshold > 0 &&
+        adaptive_pixel_error(mean, variance, samples) <= settings->threshold) {
+        return 0;
+    }
+    return remaining < settings->samplesPerPass ? remaining : settings->samplesPerPass;
+}
+
+/*
+ * Chan et al. parallel update: folds a batch of samples (count, mean, M2)
+ * into a stored mean and population variance.
+ */
+void adaptive_merge(float *mean, float *variance, unsigned int samples,
+                    float batchMean, float batchM2, unsigned int batchSamples) {
+    float total = (float)samples + batchSamples;
+    float delta = batchMean - *mean;
+    float m2 = *variance * samples + batchM2 + delta * delta * samples * batchSamples / total;
+
+    *mean += delta * batchSamples / total;
+    *variance = m2 / total;
+}
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef EZ_CHECKPOINT_H
+#define EZ_CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <ez_framebuffer.h>
+#include <ez_adaptive.h>
+#include <ez_deflate.h>
+
+/*
+ * Progressive render checkpoints. A snapshot of the framebuffer, the tile
+ * grid (activity, error) and the pass counter is written by a
+ * background thread to <path>.tmp, synced and renamed over <path>, so a
+ * checkpoint on disk is always complete. Everything that drives sampling is
+ * restored verbatim, which makes a resumed render bit-identical to an
+ * uninterrupted one.
+ */
+#define CHECKPOINT_MAGIC 0x4b435a45U
+#define CHECKPOINT_VERSION 2
+
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int settingsHash;
+    int width;
+    int height;
+    int format;
+    int tileCount;
+    int frame;
+    int passes;
+    int exportedThrough;
+} checkpoint_header_t;
+
+typedef struct {
+    char *path;
+    double interval;
+    double lastSave;
+    atomic_int writing;
+    int threadStarted;
+    pthread_t thread;
+    int status;
+    checkpoint_header_t header;
+    framebuffer_t frame;
+    tile_t *tiles;
+} checkpoint_t;
+
+double checkpoint_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+unsigned int checkpoint_hash(unsigned int hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    if (hash == 0) hash = 2166136261U;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619U;
+    }
+    return hash;
+}
+
+int checkpoint_init(checkpoint_t *checkpoint, const char *path, double interval) {
+    memset(checkpoint, 0, sizeof(*checkpoint));
+    checkpoint->path = strdup(path);
+    checkpoint->interval = interval;
+    checkpoint->lastSave = checkpoint_now();
+    atomic_init(&checkpoint->writing, 0);
+    return checkpoint->path == NULL ? -1 : 0;
+}
+
+size_t checkpoint_write_block(FILE *file, const void *data, size_t length, unsigned int *crc) {
+    *crc = crc32_update(*crc, (const unsigned char *)data, length);
+    return fwrite(data, 1, length, file);
+}
+
+int checkpoint_write(checkpoint_t *checkpoint) {
+    size_t pathLength = strlen(checkpoint->path);
+    char *temporary = malloc(pathLength + 5);
+    framebuffer_t *fb = &checkpoint->frame;
+    size_t tilesBytes = sizeof(tile_t) * checkpoint->header.tileCount;
+    size_t samplesBytes = (size_t)fb->width * fb->height * sizeof(unsigned int);
+    unsigned int crc = 0;
+    int status = 0;
+    FILE *file;
+
+    if (temporary == NULL) return -1;
+    memcpy(temporary, checkpoint->path, pathLength);
+    memcpy(temporary + pathLength, ".tmp", 5);
+
+    file = fopen(temporary, "wb");
+    if (file == NULL) {
+        free(temporary);
+        return -1;
+    }
+
+    if (checkpoint_write_block(file, &checkpoint->header, sizeof(checkpoint_header_t), &crc) != sizeof(checkpoint_header_t) ||
+        checkpoint_write_block(file, checkpoint->tiles, tilesBytes, &crc) != tilesBytes ||
+        checkpoint_write_block(file, fb->samples, samplesBytes, &crc) != samplesBytes) {
+        status = -1;
+    }
+    for (int l = 0; l < FB_LAYER_COUNT && status == 0; l++) {
+        size_t bytes = fb_layer_bytes(fb, (fb_layer)l);
+        if (checkpoint_write_block(file, fb->layers[l], bytes, &crc) != bytes) status = -1;
+    }
+    if (status == 0 && fwrite(&crc, sizeof(crc), 1, file) != 1) status = -1;
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0) status = -1;
+    if (fclose(file) != 0) status = -1;
+
+    if (status == 0 && rename(temporary, checkpoint->path) != 0) status = -1;
+    if (status != 0) remove(temporary);
+    free(temporary);
+    return status;
+}
+
+void *checkpoint_worker(void *arg) {
+    checkpoint_t *checkpoint = (checkpoint_t *)arg;
+    checkpoint->status = checkpoint_write(checkpoint);
+    atomic_store(&checkpoint->writing, 0);
+    return NULL;
+}
+
+void checkpoint_wait(checkpoint_t *checkpoint) {
+    if (checkpoint->threadStarted) {
+        pthread_join(checkpoint->thread, NULL);
+        checkpoint->threadStarted = 0;
+        fb_destroy(&checkpoint->frame);
+        free(checkpoint->tiles);
+        checkpoint->tiles = NULL;
+    }
+}
+
+int checkpoint_due(checkpoint_t *checkpoint) {
+    return checkpoint != NULL && !atomic_load(&checkpoint->writing) &&
+        checkpoint_now() - checkpoint->lastSave >= checkpoint->interval;
+}
+
+int checkpoint_save_async(checkpoint_t *checkpoint, framebuffer_t *fb, tile_grid_t *grid, checkpoint_header_t *header) {
+    checkpoint_wait(checkpoint);
+
+    checkpoint->header = *header;
+    checkpoint->header.magic = CHECKPOINT_MAGIC;
+    checkpoint->header.version = CHECKPOINT_VERSION;
+    checkpoint->header.width = fb->width;
+    checkpoint->header.height = fb->height;
+    checkpoint->header.format = fb->format;
+    checkpoint->header.tileCount = grid->count;
+    checkpoint->tiles = malloc(sizeof(tile_t) * grid->count);
+    if (checkpoint->tiles == NULL || fb_copy(&checkpoint->frame, fb) != 0) {
+        free(checkpoint->tiles);
+        checkpoint->tiles = NULL;
+        return -1;
+    }
+    memcpy(checkpoint->tiles, grid->tiles, sizeof(tile_t) * grid->count);
+
+    checkpoint->lastSave = checkpoint_now();
+    atomic_store(&checkpoint->writing, 1);
+    if (pthread_create(&checkpoint->thread, NULL, checkpoint_worker, checkpoint) != 0) {
+        atomic_store(&checkpoint->writing, 0);
+        fb_destroy(&checkpoint->frame);
+        free(checkpoint->tiles);
+        checkpoint->tiles = NULL;
+        return -1;
+    }
+    checkpoint->threadStarted = 1;
+    return 0;
+}
+
+size_t checkpoint_read_block(FILE *file, void *data, size_t length, unsigned int *crc) {
+    size_t read = fread(data, 1, length, file);
+    *crc = crc32_update(*crc, (const unsigned char *)data, read);
+    return read;
+}
+
+/* Loads a checkpoint into checkpoint->header, frame and tiles. */
+int checkpoint_load(checkpoint_t *checkpoint, unsigned int settingsHash) {
+    checkpoint_header_t *header = &checkpoint->header;
+    unsigned int crc = 0;
+    unsigned int stored;
+    int status = 0;
+    FILE *file = fopen(checkpoint->path, "rb");
+
+    if (file == NULL) return -1;
+    if (checkpoint_read_block(file, header, sizeof(*header), &crc) != sizeof(*header) ||
+        header->magic != CHECKPOINT_MAGIC || header->version != CHECKPOINT_VERSION ||
+        header->settingsHash != settingsHash || header->tileCount <= 0) {
+        fclose(file);
+        return -1;
+    }
+
+    checkpoint->tiles = malloc(sizeof(tile_t) * header->tileCount);
+    if (checkpoint->tiles == NULL ||
+        fb_create(&checkpoint->frame, header->width, header->height, (fb_format)header->format) != 0) {
+        free(checkpoint->tiles);
+        checkpoint->tiles = NULL;
+        fclose(file);
+        return -1;
+    }
+
+    size_t tilesBytes = sizeof(tile_t) * header->tileCount;
+    size_t samplesBytes = (size_t)header->width * header->height * sizeof(unsigned int);
+    if (checkpoint_read_block(file, checkpoint->tiles, tilesBytes, &crc) != tilesBytes ||
+        checkpoint_read_block(file, checkpoint->frame.samples, samplesBytes, &crc) != samplesBytes) {
+        status = -1;
+    }
+    for (int l = 0; l < FB_LAYER_COUNT && status == 0; l++) {
+        size_t bytes = fb_layer_bytes(&checkpoint->frame, (fb_layer)l);
+        if (checkpoint_read_block(file, checkpoint->frame.layers[l], bytes, &crc) != bytes) status = -1;
+    }
+    if (status == 0 && (fread(&stored, sizeof(stored), 1, file) != 1 || stored != crc)) status = -1;
+    fclose(file);
+
+    if (status != 0) {
+        fb_destroy(&checkpoint->frame);
+        free(checkpoint->tiles);
+        checkpoint->tiles = NULL;
+    }
+    return status;
+}
+
+/* Moves loaded state into a live framebuffer and tile grid; the loaded copy is released. */
+int checkpoint_restore(checkpoint_t *checkpoint, framebuffer_t *fb, tile_grid_t *grid) {
+    if (checkpoint->tiles == NULL || grid->count != checkpoint->header.tileCount ||
+        fb->width != checkpoint->frame.width || fb->height != checkpoint->frame.height ||
+        fb->format != checkpoint->frame.format) {
+        return -1;
+    }
+
+    memcpy(grid->tiles, checkpoint->tiles, sizeof(tile_t) * grid->count);
+    for (int l = 0; l < FB_LAYER_COUNT; l++) {
+        memcpy(fb->layers[l], checkpoint->frame.layers[l], fb_layer_bytes(fb, (fb_layer)l));
+    }
+    memcpy(fb->samples, checkpoint->frame.samples, (size_t)fb->width * fb->height * sizeof(unsigned int));
+
+    fb_destroy(&checkpoint->frame);
+    free(checkpoint->tiles);
+    checkpoint->tiles = NULL;
+    return 0;
+}
+
+void checkpoint_destroy(checkpoint_t *checkpoint, int removeFile) {
+    checkpoint_wait(checkpoint);
+    if (removeFile) remove(checkpoint->path);
+    fb_destroy(&checkpoint->frame);
+    free(checkpoint->tiles);
+    free(checkpoint->path);
+    checkpoint->tiles = NULL;
+    checkpoint->path = NULL;
+}
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef EZ_CLUSTER_H
+#define EZ_CLUSTER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <ez_tracer.h>
+#include <ez_memory.h>
+
+/*
+ * Out-of-core sphere storage. Spheres are grouped into spatially coherent
+ * clusters whose bounds stay resident; each cluster's spheres live in their
+ * own page aligned chunk of the scene file (x, y, z, radius and material
+ * arrays, each 64 byte aligned) that is mapped on first use and unmapped
+ * again when the least recently used chunk has to make room. Resident memory
+ * is bounded by the slot count times the largest chunk.
+ *
+ * A resident chunk is pinned without the lock: each slot keeps an atomic pin
+ * count, and eviction claims a slot by swapping a count of 0 for -1, which
+ * keeps out new pins while the slot is remapped. Only misses take the lock.
+ * Recency is the miss clock, so hits since the last miss share a stamp and
+ * LRU is approximate among them.
+ *
+ * A ray that needs a chunk another thread is already mapping waits for it
+ * instead of issuing its own I/O, so each chunk is read once per residency.
+ * A chunk that fails to map gives its slot back and comes back empty; the
+ * next acquire tries again, and every failure is counted. Callers pin one
+ * cluster at a time, so even a single slot cannot deadlock.
+ */
+#define CLUSTER_DEFAULT_SIZE 4096
+#define CLUSTER_FILE_ALIGNMENT 4096
+
+typedef struct {
+    Vec3 min;
+    Vec3 max;
+    unsigned int count;
+    unsigned int stride;
+    unsigned long long offset;
+    unsigned long long size;
+} cluster_t;
+
+typedef struct {
+    const float *x;
+    const float *y;
+    const float *z;
+    const float *radius;
+    const unsigned int *material;
+    unsigned int count;
+    int slot;
+} cluster_view_t;
+
+typedef struct {
+    atomic_int cluster;
+    atomic_int pins;
+    atomic_int ready;
+    atomic_ullong lastUse;
+    void *mapping;
+    size_t mappingSize;
+    cluster_view_t view;
+} cluster_slot_t;
+
+typedef struct {
+    unsigned long long loads;
+    unsigned long long evictions;
+    unsigned long long waits;
+    unsigned long long failures;
+} cluster_stats_t;
+
+typedef struct cluster_cache_s {
+    int fd;
+    const cluster_t *clusters;
+    int count;
+    int materialCount;
+    atomic_int *slotOf;
+    cluster_slot_t *slots;
+    int slotCount;
+    size_t budget;
+    atomic_ullong clock;
+    atomic_int waiters;
+    cluster_stats_t stats;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} cluster_cache_t;
+
+int cluster_ray_hits(const cluster_t *cluster, Vec3 *origin, Vec3 *rayDir, float tMin, float tMax) {
+    const float *lo = &cluster->min.x;
+    const float *hi = &cluster->max.x;
+    const float *o = &origin->x;
+    const float *d = &rayDir->x;
+
+    for (int axis = 0; axis < 3; axis++) {
+        float inverse = 1.0f / d[axis];
+        float t0 = (lo[axis] - o[axis]) * inverse;
+        float t1 = (hi[axis] - o[axis]) * inverse;
+        if (t0 > t1) {
+            float swap = t0;
+            t0 = t1;
+            t1 = swap;
+        }
+        tMin = t0 > tMin ? t0 : tMin;
+        tMax = t1 < tMax ? t1 : tMax;
+        if (tMin > tMax) return 0;
+    }
+    return 1;
+}
+
+unsigned int cluster_stride(unsigned int count) {
+    return (count + 15) / 16 * 16;
+}
+
+int cluster_open(cluster_cache_t *cache, int fd, const cluster_t *clusters, int count, int materialCount, size_t budget) {
+    size_t largest = 1;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->fd = fd;
+    cache->clusters = clusters;
+    cache->count = count;
+    cache->materialCount = materialCount;
+    cache->budget = budget;
+
+    for (int c = 0; c < count; c++) {
+        if (clusters[c].size > largest) largest = clusters[c].size;
+    }
+    cache->slotCount = (int)(budget / largest);
+    if (cache->slotCount < 1) cache->slotCount = 1;
+    if (cache->slotCount > count) cache->slotCount = count > 0 ? count : 1;
+
+    cache->slotOf = malloc(sizeof(atomic_int) * (count > 0 ? count : 1));
+    cache->slots = calloc(cache->slotCount, sizeof(cluster_slot_t));
+    if (cache->slotOf == NULL || cache->slots == NULL) {
+        free(cache->slotOf);
+        free(cache->slots);
+        return -1;
+    }
+    memory_add(MEMORY_ACCELERATION, sizeof(atomic_int) * (count > 0 ? count : 1) + sizeof(cluster_slot_t) * cache->slotCount);
+    for (int c = 0; c < count; c++) atomic_init(&cache->slotOf[c], -1);
+    for (int s = 0; s < cache->slotCount; s++) {
+        atomic_init(&cache->slots[s].cluster, -1);
+        atomic_init(&cache->slots[s].pins, 0);
+        atomic_init(&cache->slots[s].ready, 0);
+        atomic_init(&cache->slots[s].lastUse, 0);
+    }
+    atomic_init(&cache->clock, 0);
+    atomic_init(&cache->waiters, 0);
+
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->changed, NULL);
+    return 0;
+}
+
+void cluster_unmap(cluster_slot_t *slot) {
+    if (slot->mapping != NULL) {
+        munmap(slot->mapping, slot->mappingSize);
+        memory_add(MEMORY_GEOMETRY, -(long long)slot->mappingSize);
+    }
+    slot->mapping = NULL;
+    slot->mappingSize = 0;
+    memset(&slot->view, 0, sizeof(slot->view));
+}
+
+int cluster_map(cluster_cache_t *cache, int index, cluster_slot_t *slot) {
+    const cluster_t *cluster = &cache->clusters[index];
+    long page = sysconf(_SC_PAGESIZE);
+    off_t start = (off_t)(cluster->offset / page * page);
+    size_t lead = (size_t)(cluster->offset - start);
+    int flags = MAP_PRIVATE;
+    unsigned char *base;
+
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    slot->mappingSize = lead + cluster->size;
+    slot->mapping = mmap(NULL, slot->mappingSize, PROT_READ, flags, cache->fd, start);
+    if (slot->mapping == MAP_FAILED) {
+        slot->mapping = NULL;
+        return -1;
+    }
+    memory_add(MEMORY_GEOMETRY, slot->mappingSize);
+
+    base = (unsigned char *)slot->mapping + lead;
+    slot->view.x = (const float *)base;
+    slot->view.y = slot->view.x + cluster->stride;
+    slot->view.z = slot->view.y + cluster->stride;
+    slot->view.radius = slot->view.z + cluster->stride;
+    slot->view.material = (const unsigned int *)(slot->view.radius + cluster->stride);
+    slot->view.count = cluster->count;
+
+    if ((size_t)cluster->stride * 5 * sizeof(float) > cluster->size || cluster->count > cluster->stride) {
+        cluster_unmap(slot);
+        return -1;
+    }
+    for (unsigned int i = 0; i < cluster->count; i++) {
+        if (slot->view.material[i] >= (unsigned int)cache->materialCount) {
+            cluster_unmap(slot);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void cluster_unpin(cluster_cache_t *cache, cluster_slot_t *slot) {
+    if (atomic_fetch_sub(&slot->pins, 1) == 1 && atomic_load(&cache->waiters) > 0) {
+        pthread_mutex_lock(&cache->lock);
+        pthread_cond_broadcast(&cache->changed);
+        pthread_mutex_unlock(&cache->lock);
+    }
+}
+
+/* Pins the slot if it holds index, mapped; a count of -1 means the slot is being reassigned. */
+int cluster_try_pin(cluster_cache_t *cache, int s, int index) {
+    cluster_slot_t *slot = &cache->slots[s];
+    int pins = atomic_load(&slot->pins);
+
+    while (pins >= 0 && !atomic_compare_exchange_weak(&slot->pins, &pins, pins + 1)) {
+    }
+    if (pins < 0) return 0;
+    if (atomic_load(&slot->cluster) == index && atomic_load(&slot->ready)) return 1;
+    cluster_unpin(cache, slot);
+    return 0;
+}
+
+cluster_view_t cluster_pinned_view(cluster_cache_t *cache, int s) {
+    cluster_view_t view = cache->slots[s].view;
+    view.slot = s;
+    return view;
+}
+
+/* Pins a cluster's spheres in memory, mapping them if needed. Every call needs a cluster_release of the view. */
+cluster_view_t cluster_acquire(cluster_cache_t *cache, int index) {
+    cluster_slot_t *slot;
+    cluster_view_t view = {0};
+    int s = atomic_load(&cache->slotOf[index]);
+    int victim;
+
+    if (s >= 0 && cluster_try_pin(cache, s, index)) {
+        atomic_store(&cache->slots[s].lastUse, atomic_load(&cache->clock));
+        return cluster_pinned_view(cache, s);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    atomic_fetch_add(&cache->waiters, 1);
+    for (;;) {
+        s = atomic_load(&cache->slotOf[index]);
+        victim = -1;
+
+        if (s >= 0) {
+            if (!atomic_load(&cache->slots[s].ready)) {
+                cache->stats.waits++;
+                pthread_cond_wait(&cache->changed, &cache->lock);
+                continue;
+            }
+            /* Claims happen under the lock, so a ready slot holding index cannot be at -1 here. */
+            atomic_fetch_add(&cache->slots[s].pins, 1);
+            atomic_store(&cache->slots[s].lastUse, atomic_fetch_add(&cache->clock, 1) + 1);
+            atomic_fetch_sub(&cache->waiters, 1);
+            pthread_mutex_unlock(&cache->lock);
+            return cluster_pinned_view(cache, s);
+        }
+
+        for (int v = 0; v < cache->slotCount; v++) {
+            cluster_slot_t *candidate = &cache->slots[v];
+            int empty = atomic_load(&candidate->cluster) < 0;
+            if (atomic_load(&candidate->pins) != 0 || (!empty && !atomic_load(&candidate->ready))) continue;
+            if (victim < 0 || empty ||
+                (atomic_load(&cache->slots[victim].cluster) >= 0 &&
+                 atomic_load(&candidate->lastUse) < atomic_load(&cache->slots[victim].lastUse))) {
+                victim = v;
+            }
+            if (empty) break;
+        }
+        if (victim < 0) {
+            cache->stats.waits++;
+            pthread_cond_wait(&cache->changed, &cache->lock);
+            continue;
+        }
+
+        int unpinned = 0;
+        slot = &cache->slots[victim];
+        if (!atomic_compare_exchange_strong(&slot->pins, &unpinned, -1)) continue;
+        int previous = atomic_load(&slot->cluster);
+        if (previous >= 0) {
+            atomic_store(&cache->slotOf[previous], -1);
+            atomic_store(&slot->ready, 0);
+            cluster_unmap(slot);
+            cache->stats.evictions++;
+        }
+        atomic_store(&slot->cluster, index);
+        atomic_store(&slot->lastUse, atomic_fetch_add(&cache->clock, 1) + 1);
+        atomic_store(&cache->slotOf[index], victim);
+        atomic_store(&slot->pins, 1);
+        break;
+    }
+    atomic_fetch_sub(&cache->waiters, 1);
+    pthread_mutex_unlock(&cache->lock);
+
+    int failed = cluster_map(cache, index, slot) != 0;
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stats.loads++;
+    if (failed) {
+        cache->stats.failures++;
+        atomic_store(&cache->slotOf[index], -1);
+        atomic_store(&slot->cluster, -1);
+        /* Readers may hold a pin from cluster_try_pin right now; drop only ours and let them drop theirs. */
+        atomic_fetch_sub(&slot->pins, 1);
+        view.slot = -1;
+    } else {
+        atomic_store(&slot->ready, 1);
+        view = cluster_pinned_view(cache, victim);
+    }
+    pthread_cond_broadcast(&cache->changed);
+    pthread_mutex_unlock(&cache->lock);
+    return view;
+}
+
+void cluster_release(cluster_cache_t *cache, const cluster_view_t *view) {
+    if (view->slot >= 0) cluster_unpin(cache, &cache->slots[view->slot]);
+}
+
+cluster_stats_t cluster_take_stats(cluster_cache_t *cache) {
+    cluster_stats_t stats;
+    pthread_mutex_lock(&cache->lock);
+    stats = cache->stats;
+    memset(&cache->stats, 0, sizeof(cache->stats));
+    pthread_mutex_unlock(&cache->lock);
+    return stats;
+}
+
+int cluster_resident(cluster_cache_t *cache, size_t *bytes) {
+    int resident = 0;
+    pthread_mutex_lock(&cache->lock);
+    *bytes = 0;
+    for (int s = 0; s < cache->slotCount; s++) {
+        if (atomic_load(&cache->slots[s].ready)) {
+            resident++;
+            *bytes += cache->slots[s].mappingSize;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return resident;
+}
+
+void cluster_close(cluster_cache_t *cache) {
+    for (int s = 0; s < cache->slotCount; s++) cluster_unmap(&cache->slots[s]);
+    if (cache->slots != NULL) {
+        memory_add(MEMORY_ACCELERATION,
+                   -(long long)(sizeof(atomic_int) * (cache->count > 0 ? cache->count : 1) + sizeof(cluster_slot_t) * cache->slotCount));
+    }
+    if (cache->fd >= 0) close(cache->fd);
+    free(cache->slotOf);
+    free(cache->slots);
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->changed);
+    cache->slotOf = NULL;
+    cache->slots = NULL;
+    cache->fd = -1;
+}
+
+#endif
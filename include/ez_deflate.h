@@ -0,0 +1,206 @@
+#ifndef EZ_DEFLATE_H
+#define EZ_DEFLATE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <ez_memory.h>
+
+/*
+ * Incremental DEFLATE (RFC 1951) encoder using the fixed Huffman tables and
+ * greedy LZ77 matching. Every deflate_write() call becomes one block whose
+ * matches stay inside that call, so memory is bounded by the caller's chunk
+ * size and compressed bytes can be drained after each call.
+ */
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+
+typedef struct {
+    unsigned char *out;
+    size_t outLength;
+    size_t outCapacity;
+    unsigned int bitBuffer;
+    int bitCount;
+    int *head;
+    int failed;
+} deflate_t;
+
+const unsigned short DEFLATE_LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+const unsigned char DEFLATE_LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+const unsigned short DEFLATE_DIST_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+const unsigned char DEFLATE_DIST_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+unsigned int crc32_update(unsigned int crc, const unsigned char *data, size_t length) {
+    static unsigned int table[256];
+    static int ready = 0;
+
+    if (!ready) {
+        for (unsigned int n = 0; n < 256; n++) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xedb88320U ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        ready = 1;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+unsigned int adler32_update(unsigned int adler, const unsigned char *data, size_t length) {
+    unsigned int a = adler & 0xffff;
+    unsigned int b = adler >> 16;
+
+    while (length > 0) {
+        size_t run = length < 5552 ? length : 5552;
+        length -= run;
+        while (run-- > 0) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+int deflate_init(deflate_t *d) {
+    memset(d, 0, sizeof(*d));
+    d->head = malloc(sizeof(int) << DEFLATE_HASH_BITS);
+    if (d->head == NULL) return -1;
+    memory_add(MEMORY_OUTPUT, sizeof(int) << DEFLATE_HASH_BITS);
+    return 0;
+}
+
+void deflate_destroy(deflate_t *d) {
+    if (d->head != NULL) memory_add(MEMORY_OUTPUT, -(long long)((sizeof(int) << DEFLATE_HASH_BITS) + d->outCapacity));
+    free(d->head);
+    free(d->out);
+    d->head = NULL;
+    d->out = NULL;
+    d->outCapacity = 0;
+}
+
+void deflate_reserve(deflate_t *d, size_t extra) {
+    if (d->failed || d->outLength + extra <= d->outCapacity) return;
+
+    size_t capacity = d->outCapacity ? d->outCapacity : 4096;
+    while (capacity < d->outLength + extra) capacity *= 2;
+
+    unsigned char *grown = realloc(d->out, capacity);
+    if (grown == NULL) {
+        d->failed = 1;
+        return;
+    }
+    memory_add(MEMORY_OUTPUT, (long long)(capacity - d->outCapacity));
+    d->out = grown;
+    d->outCapacity = capacity;
+}
+
+void deflate_bits(deflate_t *d, unsigned int value, int count) {
+    d->bitBuffer |= value << d->bitCount;
+    d->bitCount += count;
+    deflate_reserve(d, 4);
+    while (d->bitCount >= 8) {
+        if (!d->failed) d->out[d->outLength++] = (unsigned char)d->bitBuffer;
+        d->bitBuffer >>= 8;
+        d->bitCount -= 8;
+    }
+}
+
+void deflate_code(deflate_t *d, unsigned int code, int length) {
+    unsigned int reversed = 0;
+    for (int i = 0; i < length; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    deflate_bits(d, reversed, length);
+}
+
+void deflate_literal(deflate_t *d, int symbol) {
+    if (symbol < 144) deflate_code(d, 0x30 + symbol, 8);
+    else if (symbol < 256) deflate_code(d, 0x190 + symbol - 144, 9);
+    else if (symbol < 280) deflate_code(d, symbol - 256, 7);
+    else deflate_code(d, 0xc0 + symbol - 280, 8);
+}
+
+void deflate_match(deflate_t *d, int length, int distance) {
+    int l = 28;
+    int k = 29;
+
+    while (DEFLATE_LENGTH_BASE[l] > length) l--;
+    deflate_literal(d, 257 + l);
+    deflate_bits(d, length - DEFLATE_LENGTH_BASE[l], DEFLATE_LENGTH_EXTRA[l]);
+
+    while (DEFLATE_DIST_BASE[k] > distance) k--;
+    deflate_code(d, k, 5);
+    deflate_bits(d, distance - DEFLATE_DIST_BASE[k], DEFLATE_DIST_EXTRA[k]);
+}
+
+unsigned int deflate_hash(const unsigned char *p) {
+    unsigned int v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v * 2654435761U) >> (32 - DEFLATE_HASH_BITS);
+}
+
+void deflate_block(deflate_t *d, const unsigned char *data, size_t length, int final) {
+    size_t i = 0;
+
+    for (int h = 0; h < (1 << DEFLATE_HASH_BITS); h++) d->head[h] = -1;
+    deflate_bits(d, final ? 3 : 2, 3);
+
+    while (i < length) {
+        int best = 0;
+        if (i + DEFLATE_MIN_MATCH <= length) {
+            unsigned int h = deflate_hash(data + i);
+            int candidate = d->head[h];
+            d->head[h] = (int)i;
+            if (candidate >= 0 && i - candidate <= DEFLATE_WINDOW) {
+                size_t limit = length - i < DEFLATE_MAX_MATCH ? length - i : DEFLATE_MAX_MATCH;
+                while ((size_t)best < limit && data[candidate + best] == data[i + best]) best++;
+                if (best >= DEFLATE_MIN_MATCH) {
+                    deflate_match(d, best, (int)(i - candidate));
+                    for (size_t j = i + 1; j < i + best && j + DEFLATE_MIN_MATCH <= length; j++) {
+                        d->head[deflate_hash(data + j)] = (int)j;
+                    }
+                    i += best;
+                    continue;
+                }
+            }
+        }
+        deflate_literal(d, data[i]);
+        i++;
+    }
+    deflate_literal(d, 256);
+}
+
+void deflate_write(deflate_t *d, const unsigned char *data, size_t length) {
+    deflate_block(d, data, length, 0);
+}
+
+void deflate_finish(deflate_t *d) {
+    deflate_block(d, NULL, 0, 1);
+    if (d->bitCount > 0) deflate_bits(d, 0, 8 - d->bitCount);
+}
+
+void deflate_drain(deflate_t *d) {
+    d->outLength = 0;
+}
+
+#endif
@@ -0,0 +1,415 @@
+#ifndef EZ_DENOISE_H
+#define EZ_DENOISE_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ez_framebuffer.h>
+#include <ez_adaptive.h>
+#include <ez_parallel.h>
+#include <ez_memory.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with the edge
+ * stopping functions of SVGF (Schied et al. 2017), for previews rendered with
+ * a handful of samples per pixel.
+ *
+ * Beauty is divided by albedo first, so textures pass through untouched and
+ * only lighting is blurred; the result is multiplied back at the end. Albedo
+ * is clamped to DENOISE_ALBEDO_FLOOR, since mirror reflections put light into
+ * channels the surface's own albedo has none of. Each of
+ * DENOISE_ITERATIONS passes applies the 5x5 B3 spline kernel with its taps
+ * 2^i pixels apart and weights every tap by how alike it is to the centre:
+ *
+ *   luminance  |l_i - l_j| / (sigma_l * sqrt(var_i) + eps), var_i being the
+ *              variance of the pixel mean, so noisy pixels blur more and
+ *              converged ones barely move
+ *   normal     sigma_n * (n_i . n_i - n_i . n_j)
+ *   depth      |z_i - z_j| / (sigma_z * z_i * tap distance in pixels)
+ *
+ * A pixel with fewer than DENOISE_SPATIAL_SAMPLES samples has too few to
+ * estimate its own variance; like SVGF's first frames it takes the luminance
+ * variance of its 3x3 neighbourhood instead, weighted by the normal and depth
+ * terms and divided by its sample count.
+ *
+ * w = h(x) h(y) exp(-(sum of the three)), so the centre always keeps its own
+ * kernel weight. Variance is filtered alongside with the squared weights, so
+ * later passes trust the smoothed values more. Misses have a zero normal and
+ * T_MAX depth: geometry ignores them through its normal term and they ignore
+ * geometry through luminance, the background being noise free.
+ *
+ * Passes run over bands of rows on the parallel_for pool and ping-pong
+ * between two sets of planes. Interior pixels go four at a time through SSE2;
+ * pixels whose taps leave the image take the scalar path, which computes the
+ * same values.
+ */
+#define DENOISE_ITERATIONS 5
+#define DENOISE_BAND_ROWS 16
+#define DENOISE_PLANES 17
+#define DENOISE_SCRATCH_ROWS 11
+#define DENOISE_SPATIAL_SAMPLES 8
+#define DENOISE_SPATIAL_RADIUS 1
+#define DENOISE_SIGMA_LUMINANCE 4.0f
+#define DENOISE_SIGMA_NORMAL 64.0f
+#define DENOISE_SIGMA_DEPTH 0.02f
+#define DENOISE_EPSILON 1e-4f
+#define DENOISE_ALBEDO_FLOOR 0.1f
+#define DENOISE_MAX_EXPONENT 80.0f
+
+typedef enum {
+    DENOISE_LOAD,
+    DENOISE_VARIANCE,
+    DENOISE_FILTER,
+    DENOISE_RESOLVE
+} denoise_stage;
+
+typedef struct {
+    framebuffer_t *fb;
+    int width;
+    int height;
+    int threads;
+    denoise_stage stage;
+    int source;
+    int step;
+    float *color[2][3];
+    float *luminance[2];
+    float *variance[2];
+    float *albedo[3];
+    float *normal[3];
+    float *depth;
+    float *planes;
+    float *scratch;
+    float *out;
+    size_t bytes;
+} denoise_t;
+
+const float denoiseKernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+
+/* e^x for x <= 0: 2^f on [0, 1) as a degree five polynomial, then exact scaling by 2^i. Relative error < 2e-4. */
+float denoise_exp(float x) {
+    float t = fmaxf(x, -DENOISE_MAX_EXPONENT) * 1.44269504f;
+    int i = (int)t - ((float)(int)t > t);
+    float f = t - i;
+    float p = 1.0f + f * (0.69314718f + f * (0.24022650f + f * (0.05550411f + f * (0.00961813f + f * 0.00133336f))));
+    unsigned int bits = (unsigned int)(i + 127) << 23;
+    float scale;
+
+    memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+#ifdef __SSE2__
+__m128 denoise_exp4(__m128 x) {
+    __m128 t = _mm_mul_ps(_mm_max_ps(x, _mm_set1_ps(-DENOISE_MAX_EXPONENT)), _mm_set1_ps(1.44269504f));
+    __m128 i = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+    i = _mm_sub_ps(i, _mm_and_ps(_mm_cmpgt_ps(i, t), _mm_set1_ps(1.0f)));
+    __m128 f = _mm_sub_ps(t, i);
+    __m128 p = _mm_set1_ps(0.00133336f);
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.00961813f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.05550411f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.24022650f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.69314718f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+    __m128i scale = _mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(i), _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(p, _mm_castsi128_ps(scale));
+}
+#endif
+
+void denoise_destroy(denoise_t *d) {
+    if (d->planes != NULL) memory_add(MEMORY_FRAMEBUFFER, -(long long)d->bytes);
+    free(d->planes);
+    free(d->scratch);
+    d->planes = NULL;
+    d->scratch = NULL;
+}
+
+/* Planes for fb's size plus row scratch for up to threads workers. */
+int denoise_create(denoise_t *d, framebuffer_t *fb, int threads) {
+    size_t plane = (size_t)fb->width * fb->height;
+
+    memset(d, 0, sizeof(*d));
+    if (threads < 1) threads = 1;
+    if (threads > PARALLEL_MAX_THREADS) threads = PARALLEL_MAX_THREADS;
+    d->fb = fb;
+    d->width = fb->width;
+    d->height = fb->height;
+    d->threads = threads;
+    d->planes = malloc(sizeof(float) * plane * DENOISE_PLANES);
+    d->scratch = malloc(sizeof(float) * fb->width * DENOISE_SCRATCH_ROWS * threads);
+    if (d->planes == NULL || d->scratch == NULL) {
+        free(d->planes);
+        free(d->scratch);
+        d->planes = NULL;
+        d->scratch = NULL;
+        return -1;
+    }
+    d->depth = d->planes;
+    for (int s = 0; s < 2; s++) {
+        for (int c = 0; c < 3; c++) {
+            d->color[s][c] = d->planes + plane * (1 + 3 * s + c);
+        }
+        d->luminance[s] = d->planes + plane * (7 + s);
+        d->variance[s] = d->planes + plane * (9 + s);
+    }
+    for (int c = 0; c < 3; c++) {
+        d->albedo[c] = d->planes + plane * (11 + c);
+        d->normal[c] = d->planes + plane * (14 + c);
+    }
+    d->bytes = sizeof(float) * (plane * DENOISE_PLANES + (size_t)fb->width * DENOISE_SCRATCH_ROWS * threads);
+    memory_add(MEMORY_FRAMEBUFFER, d->bytes);
+    return 0;
+}
+
+/* Demodulated colour, clamped albedo, unit normal, depth and variance of the mean for one row. */
+void denoise_load_row(denoise_t *d, int y, float *scratch) {
+    int w = d->width;
+    float *beauty = scratch;
+    float *albedo = scratch + 3 * w;
+    float *normal = scratch + 6 * w;
+    float *depth = scratch + 9 * w;
+    float *variance = scratch + 10 * w;
+
+    fb_load_row(d->fb, FB_LAYER_BEAUTY, y, beauty);
+    fb_load_row(d->fb, FB_LAYER_ALBEDO, y, albedo);
+    fb_load_row(d->fb, FB_LAYER_NORMAL, y, normal);
+    fb_load_row(d->fb, FB_LAYER_DEPTH, y, depth);
+    fb_load_row(d->fb, FB_LAYER_VARIANCE, y, variance);
+
+    for (int x = 0; x < w; x++) {
+        size_t i = (size_t)y * w + x;
+        unsigned int samples = d->fb->samples[i] > 0 ? d->fb->samples[i] : 1;
+        float length = sqrtf(normal[3*x] * normal[3*x] + normal[3*x + 1] * normal[3*x + 1] +
+                             normal[3*x + 2] * normal[3*x + 2]);
+        float color[3];
+
+        for (int c = 0; c < 3; c++) {
+            float a = fmaxf(albedo[3*x + c], DENOISE_ALBEDO_FLOOR);
+            d->albedo[c][i] = a;
+            color[c] = beauty[3*x + c] / a;
+            d->color[0][c][i] = color[c];
+            d->normal[c][i] = length > 0 ? normal[3*x + c] / length : 0;
+        }
+        float shade = luminance(d->albedo[0][i], d->albedo[1][i], d->albedo[2][i]);
+        d->luminance[0][i] = luminance(color[0], color[1], color[2]);
+        d->variance[1][i] = variance[x] / samples / (shade * shade);
+        d->depth[i] = depth[x];
+    }
+}
+
+/* 1 / (sigma_z * z_i), the depth term's scale for taps one pixel away from i. */
+float denoise_nearness(denoise_t *d, size_t i) {
+    return 1 / (DENOISE_SIGMA_DEPTH * d->depth[i] + DENOISE_EPSILON);
+}
+
+/* Normal and depth part of the edge stopping exponent between pixels i and j, nearness over their distance apart. */
+float denoise_geometry(denoise_t *d, size_t i, size_t j, float nearness) {
+    float facing = d->normal[0][i] * d->normal[0][i] + d->normal[1][i] * d->normal[1][i] +
+                   d->normal[2][i] * d->normal[2][i];
+    float dot = d->normal[0][i] * d->normal[0][j] + d->normal[1][i] * d->normal[1][j] +
+                d->normal[2][i] * d->normal[2][j];
+    return DENOISE_SIGMA_NORMAL * (facing - dot) + fabsf(d->depth[i] - d->depth[j]) * nearness;
+}
+
+void denoise_variance_row(denoise_t *d, int y) {
+    int w = d->width;
+
+    for (int x = 0; x < w; x++) {
+        size_t i = (size_t)y * w + x;
+        unsigned int samples = d->fb->samples[i] > 0 ? d->fb->samples[i] : 1;
+        float nearness = denoise_nearness(d, i);
+        float sum = 0, squares = 0, weightSum = 0;
+
+        if (samples >= DENOISE_SPATIAL_SAMPLES) {
+            d->variance[0][i] = d->variance[1][i];
+            continue;
+        }
+        for (int yy = y - DENOISE_SPATIAL_RADIUS; yy <= y + DENOISE_SPATIAL_RADIUS; yy++) {
+            if (yy < 0 || yy >= d->height) continue;
+            for (int xx = x - DENOISE_SPATIAL_RADIUS; xx <= x + DENOISE_SPATIAL_RADIUS; xx++) {
+                if (xx < 0 || xx >= w) continue;
+                size_t j = (size_t)yy * w + xx;
+                int distance = abs(xx - x) > abs(yy - y) ? abs(xx - x) : abs(yy - y);
+                float weight = denoise_exp(-denoise_geometry(d, i, j, nearness / (distance > 0 ? distance : 1)));
+                float l = d->luminance[0][j];
+                sum += weight * l;
+                squares += weight * l * l;
+                weightSum += weight;
+            }
+        }
+        float mean = sum / weightSum;
+        d->variance[0][i] = fmaxf(d->variance[1][i], fmaxf(squares / weightSum - mean * mean, 0) / samples);
+    }
+}
+
+void denoise_pixel(denoise_t *d, int x, int y) {
+    int s = d->source;
+    int step = d->step;
+    int w = d->width;
+    size_t i = (size_t)y * w + x;
+    float li = d->luminance[s][i];
+    float lumScale = 1 / (DENOISE_SIGMA_LUMINANCE * sqrtf(d->variance[s][i]) + DENOISE_EPSILON);
+    float nearness = denoise_nearness(d, i) / step;
+    float sum[3] = {0, 0, 0};
+    float varianceSum = 0;
+    float weightSum = 0;
+
+    for (int dy = -2; dy <= 2; dy++) {
+        int yy = y + dy * step;
+        if (yy < 0 || yy >= d->height) continue;
+        for (int dx = -2; dx <= 2; dx++) {
+            int xx = x + dx * step;
+            if (xx < 0 || xx >= w) continue;
+
+            size_t j = (size_t)yy * w + xx;
+            int distance = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
+            float e = fabsf(li - d->luminance[s][j]) * lumScale +
+                      denoise_geometry(d, i, j, nearness / (distance > 0 ? distance : 1));
+            float weight = denoiseKernel[dx + 2] * denoiseKernel[dy + 2] * denoise_exp(-e);
+
+            for (int c = 0; c < 3; c++) {
+                sum[c] += weight * d->color[s][c][j];
+            }
+            varianceSum += weight * weight * d->variance[s][j];
+            weightSum += weight;
+        }
+    }
+
+    for (int c = 0; c < 3; c++) {
+        d->color[1 - s][c][i] = sum[c] / weightSum;
+    }
+    d->luminance[1 - s][i] = luminance(d->color[1 - s][0][i], d->color[1 - s][1][i], d->color[1 - s][2][i]);
+    d->variance[1 - s][i] = varianceSum / (weightSum * weightSum);
+}
+
+#ifdef __SSE2__
+/* denoise_pixel for x .. x + 3, all of whose horizontal taps lie inside the image. */
+void denoise_pixel4(denoise_t *d, int x, int y) {
+    int s = d->source;
+    int step = d->step;
+    int w = d->width;
+    size_t i = (size_t)y * w + x;
+    __m128 li = _mm_loadu_ps(d->luminance[s] + i);
+    __m128 zi = _mm_loadu_ps(d->depth + i);
+    __m128 nx = _mm_loadu_ps(d->normal[0] + i);
+    __m128 ny = _mm_loadu_ps(d->normal[1] + i);
+    __m128 nz = _mm_loadu_ps(d->normal[2] + i);
+    __m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+    __m128 epsilon = _mm_set1_ps(DENOISE_EPSILON);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 lumScale = _mm_div_ps(one, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(DENOISE_SIGMA_LUMINANCE),
+                                                            _mm_sqrt_ps(_mm_loadu_ps(d->variance[s] + i))), epsilon));
+    __m128 nearness = _mm_div_ps(_mm_set1_ps(1.0f / step),
+                                 _mm_add_ps(_mm_mul_ps(_mm_set1_ps(DENOISE_SIGMA_DEPTH), zi), epsilon));
+    __m128 r = _mm_setzero_ps(), g = _mm_setzero_ps(), b = _mm_setzero_ps();
+    __m128 varianceSum = _mm_setzero_ps();
+    __m128 weightSum = _mm_setzero_ps();
+
+    for (int dy = -2; dy <= 2; dy++) {
+        int yy = y + dy * step;
+        if (yy < 0 || yy >= d->height) continue;
+        for (int dx = -2; dx <= 2; dx++) {
+            size_t j = (size_t)yy * w + x + dx * step;
+            int distance = abs(dx) > abs(dy) ? abs(dx) : abs(dy);
+            __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(d->normal[0] + j)),
+                                               _mm_mul_ps(ny, _mm_loadu_ps(d->normal[1] + j))),
+                                    _mm_mul_ps(nz, _mm_loadu_ps(d->normal[2] + j)));
+            __m128 lum = _mm_andnot_ps(sign, _mm_sub_ps(li, _mm_loadu_ps(d->luminance[s] + j)));
+            __m128 depth = _mm_andnot_ps(sign, _mm_sub_ps(zi, _mm_loadu_ps(d->depth + j)));
+            __m128 e = _mm_mul_ps(lum, lumScale);
+            e = _mm_add_ps(e, _mm_mul_ps(_mm_set1_ps(DENOISE_SIGMA_NORMAL), _mm_sub_ps(facing, dot)));
+            e = _mm_add_ps(e, _mm_mul_ps(depth, _mm_mul_ps(nearness, _mm_set1_ps(1.0f / (distance > 0 ? distance : 1)))));
+            __m128 weight = _mm_mul_ps(_mm_set1_ps(denoiseKernel[dx + 2] * denoiseKernel[dy + 2]),
+                                       denoise_exp4(_mm_sub_ps(_mm_setzero_ps(), e)));
+
+            r = _mm_add_ps(r, _mm_mul_ps(weight, _mm_loadu_ps(d->color[s][0] + j)));
+            g = _mm_add_ps(g, _mm_mul_ps(weight, _mm_loadu_ps(d->color[s][1] + j)));
+            b = _mm_add_ps(b, _mm_mul_ps(weight, _mm_loadu_ps(d->color[s][2] + j)));
+            varianceSum = _mm_add_ps(varianceSum, _mm_mul_ps(_mm_mul_ps(weight, weight), _mm_loadu_ps(d->variance[s] + j)));
+            weightSum = _mm_add_ps(weightSum, weight);
+        }
+    }
+
+    __m128 inverse = _mm_div_ps(one, weightSum);
+    r = _mm_mul_ps(r, inverse);
+    g = _mm_mul_ps(g, inverse);
+    b = _mm_mul_ps(b, inverse);
+    _mm_storeu_ps(d->color[1 - s][0] + i, r);
+    _mm_storeu_ps(d->color[1 - s][1] + i, g);
+    _mm_storeu_ps(d->color[1 - s][2] + i, b);
+    _mm_storeu_ps(d->luminance[1 - s] + i,
+                  _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.2126f)), _mm_mul_ps(g, _mm_set1_ps(0.7152f))),
+                             _mm_mul_ps(b, _mm_set1_ps(0.0722f))));
+    _mm_storeu_ps(d->variance[1 - s] + i, _mm_mul_ps(varianceSum, _mm_mul_ps(inverse, inverse)));
+}
+#endif
+
+void denoise_filter_row(denoise_t *d, int y) {
+    int reach = 2 * d->step;
+    int x = 0;
+
+    for (; x < d->width && x < reach; x++) {
+        denoise_pixel(d, x, y);
+    }
+#ifdef __SSE2__
+    for (; x + 4 <= d->width - reach; x += 4) {
+        denoise_pixel4(d, x, y);
+    }
+#endif
+    for (; x < d->width; x++) {
+        denoise_pixel(d, x, y);
+    }
+}
+
+/* Multiplies albedo back in, into out (interleaved RGB) or, without one, the framebuffer's beauty layer. */
+void denoise_resolve_row(denoise_t *d, int y, float *scratch) {
+    int s = d->source;
+    float *row = d->out != NULL ? d->out + (size_t)y * d->width * 3 : scratch;
+
+    for (int x = 0; x < d->width; x++) {
+        size_t i = (size_t)y * d->width + x;
+        for (int c = 0; c < 3; c++) {
+            row[3*x + c] = d->color[s][c][i] * d->albedo[c][i];
+        }
+    }
+    if (d->out == NULL) fb_store_row(d->fb, FB_LAYER_BEAUTY, y, row);
+}
+
+void denoise_band(void *ctx, int index, int thread) {
+    denoise_t *d = (denoise_t *)ctx;
+    float *scratch = d->scratch + (size_t)d->width * DENOISE_SCRATCH_ROWS * thread;
+    int end = (index + 1) * DENOISE_BAND_ROWS < d->height ? (index + 1) * DENOISE_BAND_ROWS : d->height;
+
+    for (int y = index * DENOISE_BAND_ROWS; y < end; y++) {
+        if (d->stage == DENOISE_LOAD) denoise_load_row(d, y, scratch);
+        else if (d->stage == DENOISE_VARIANCE) denoise_variance_row(d, y);
+        else if (d->stage == DENOISE_FILTER) denoise_filter_row(d, y);
+        else denoise_resolve_row(d, y, scratch);
+    }
+}
+
+/* Filters the framebuffer's current beauty into out, or back into beauty when out is NULL. */
+void denoise_run(denoise_t *d, float *out) {
+    int bands = (d->height + DENOISE_BAND_ROWS - 1) / DENOISE_BAND_ROWS;
+
+    d->out = out;
+    d->stage = DENOISE_LOAD;
+    parallel_for(bands, d->threads, denoise_band, d);
+    d->stage = DENOISE_VARIANCE;
+    parallel_for(bands, d->threads, denoise_band, d);
+    d->stage = DENOISE_FILTER;
+    for (int pass = 0; pass < DENOISE_ITERATIONS; pass++) {
+        d->source = pass & 1;
+        d->step = 1 << pass;
+        parallel_for(bands, d->threads, denoise_band, d);
+    }
+    d->source = DENOISE_ITERATIONS & 1;
+    d->stage = DENOISE_RESOLVE;
+    parallel_for(bands, d->threads, denoise_band, d);
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef EZ_FRAMEBUFFER_H
+#define EZ_FRAMEBUFFER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <ez_tracer.h>
+#include <ez_half.h>
+#include <ez_memory.h>
+
+/*
+ * Render layers stored either as float32 or as IEEE half. Beauty holds the
+ * running mean of all samples, not a sum, so half storage keeps full relative
+ * precision no matter how many samples land in a pixel. Each store rounds once
+ * (relative error <= 2^-11); a pixel refined over k progressive passes is off
+ * by at most (k + 1) / 2 * 2^-11 and typically by sqrt(k) * 2^-11, so up to
+ * 16 passes stay within one step of the 8 bit output. Depth saturates at
+ * 65504 and has a spacing of about t * 2^-10. Variance holds the population
+ * variance of beauty luminance and is stored in the same format; per-pixel
+ * sample counts are always 32 bit. Cost holds the wall-clock seconds spent
+ * tracing each pixel and steps the box and sphere tests its rays made, both
+ * summed over passes, always as float32.
+ */
+typedef enum {
+    FB_LAYER_BEAUTY,
+    FB_LAYER_ALBEDO,
+    FB_LAYER_NORMAL,
+    FB_LAYER_DEPTH,
+    FB_LAYER_VARIANCE,
+    FB_LAYER_COUNT
+} fb_layer;
+
+typedef enum {
+    FB_FLOAT32,
+    FB_FLOAT16
+} fb_format;
+
+typedef struct {
+    int width;
+    int height;
+    fb_format format;
+    void *layers[FB_LAYER_COUNT];
+    unsigned int *samples;
+    float *cost;
+    float *steps;
+} framebuffer_t;
+
+int fb_layer_channels(fb_layer layer) {
+    return layer == FB_LAYER_DEPTH || layer == FB_LAYER_VARIANCE ? 1 : 3;
+}
+
+size_t fb_format_size(fb_format format) {
+    return format == FB_FLOAT16 ? sizeof(half) : sizeof(float);
+}
+
+size_t fb_layer_bytes(framebuffer_t *fb, fb_layer layer) {
+    return (size_t)fb->width * fb->height * fb_layer_channels(layer) * fb_format_size(fb->format);
+}
+
+size_t fb_bytes(framebuffer_t *fb) {
+    size_t total = 0;
+    for (int l = 0; l < FB_LAYER_COUNT; l++) {
+        total += fb_layer_bytes(fb, (fb_layer)l);
+    }
+    return total + (size_t)fb->width * fb->height * (sizeof(unsigned int) + 2 * sizeof(float));
+}
+
+void fb_destroy(framebuffer_t *fb) {
+    if (fb->samples != NULL && fb->cost != NULL && fb->steps != NULL) memory_add(MEMORY_FRAMEBUFFER, -(long long)fb_bytes(fb));
+    for (int l = 0; l < FB_LAYER_COUNT; l++) {
+        free(fb->layers[l]);
+        fb->layers[l] = NULL;
+    }
+    free(fb->samples);
+    free(fb->cost);
+    free(fb->steps);
+    fb->samples = NULL;
+    fb->cost = NULL;
+    fb->steps = NULL;
+}
+
+int fb_create(framebuffer_t *fb, int width, int height, fb_format format) {
+    memset(fb, 0, sizeof(*fb));
+    fb->width = width;
+    fb->height = height;
+    fb->format = format;
+
+    for (int l = 0; l < FB_LAYER_COUNT; l++) {
+        fb->layers[l] = calloc(1, fb_layer_bytes(fb, (fb_layer)l));
+        if (fb->layers[l] == NULL) {
+            fb_destroy(fb);
+            return -1;
+        }
+    }
+    fb->samples = calloc((size_t)width * height, sizeof(unsigned int));
+    fb->cost = calloc((size_t)width * height, sizeof(float));
+    fb->steps = calloc((size_t)width * height, sizeof(float));
+    if (fb->samples == NULL || fb->cost == NULL || fb->steps == NULL) {
+        fb_destroy(fb);
+        return -1;
+    }
+    memory_add(MEMORY_FRAMEBUFFER, fb_bytes(fb));
+    return 0;
+}
+
+int fb_copy(framebuffer_t *dst, framebuffer_t *src) {
+    if (fb_create(dst, src->width, src->height, src->format) != 0) return -1;
+    for (int l = 0; l < FB_LAYER_COUNT; l++) {
+        memcpy(dst->layers[l], src->layers[l], fb_layer_bytes(src, (fb_layer)l));
+    }
+    memcpy(dst->samples, src->samples, (size_t)src->width * src->height * sizeof(unsigned int));
+    memcpy(dst->cost, src->cost, (size_t)src->width * src->height * sizeof(float));
+    memcpy(dst->steps, src->steps, (size_t)src->width * src->height * sizeof(float));
+    return 0;
+}
+
+void fb_clear(framebuffer_t *fb) {
+    for (int l = 0; l < FB_LAYER_COUNT; l++) {
+        memset(fb->layers[l], 0, fb_layer_bytes(fb, (fb_layer)l));
+    }
+    memset(fb->samples, 0, (size_t)fb->width * fb->height * sizeof(unsigned int));
+    memset(fb->cost, 0, (size_t)fb->width * fb->height * sizeof(float));
+    memset(fb->steps, 0, (size_t)fb->width * fb->height * sizeof(float));
+}
+
+/* The splitmix64 finalizer: every input bit flips each output bit with probability about one half. */
+unsigned long long fb_mix(unsigned long long x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/*
+ * Folds data into hash eight bytes at a time, running the state through
+ * fb_mix after each word so that a change anywhere in a word reaches every
+ * bit. The tail is zero padded and tagged with its length.
+ */
+unsigned long long fb_hash_bytes(unsigned long long hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned long long tail = 0;
+    size_t i = 0;
+
+    for (; i + sizeof(unsigned long long) <= length; i += sizeof(unsigned long long)) {
+        unsigned long long word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = fb_mix(hash ^ word);
+    }
+    if (i < length) {
+        memcpy(&tail, bytes + i, length - i);
+        hash = fb_mix(hash ^ tail ^ ((unsigned long long)(length - i) << 56));
+    }
+    return hash;
+}
+
+/*
+ * Hash of the frame's dimensions, format, layers and sample counts. Cost and
+ * steps are timings and diagnostics, not content, and are left out.
+ */
+unsigned long long fb_hash(framebuffer_t *fb) {
+    int header[3] = {fb->width, fb->height, fb->format};
+    unsigned long long hash = fb_hash_bytes(0xcbf29ce484222325ULL, header, sizeof(header));
+
+    for (int l = 0; l < FB_LAYER_COUNT; l++) {
+        hash = fb_hash_bytes(hash, fb->layers[l], fb_layer_bytes(fb, (fb_layer)l));
+    }
+    return fb_hash_bytes(hash, fb->samples, (size_t)fb->width * fb->height * sizeof(unsigned int));
+}
+
+void fb_store_span(framebuffer_t *fb, fb_layer layer, int x, int y, int count, const float *values) {
+    int channels = fb_layer_channels(layer);
+    size_t n = (size_t)count * channels;
+    size_t offset = ((size_t)y * fb->width + x) * channels;
+
+    if (fb->format == FB_FLOAT16) {
+        half_from_float_n((half *)fb->layers[layer] + offset, values, n);
+    } else {
+        memcpy((float *)fb->layers[layer] + offset, values, n * sizeof(float));
+    }
+}
+
+void fb_load_span(framebuffer_t *fb, fb_layer layer, int x, int y, int count, float *values) {
+    int channels = fb_layer_channels(layer);
+    size_t n = (size_t)count * channels;
+    size_t offset = ((size_t)y * fb->width + x) * channels;
+
+    if (fb->format == FB_FLOAT16) {
+        half_to_float_n(values, (half *)fb->layers[layer] + offset, n);
+    } else {
+        memcpy(values, (float *)fb->layers[layer] + offset, n * sizeof(float));
+    }
+}
+
+void fb_store_row(framebuffer_t *fb, fb_layer layer, int y, const float *values) {
+    fb_store_span(fb, layer, 0, y, fb->width, values);
+}
+
+void fb_load_row(framebuffer_t *fb, fb_layer layer, int y, float *values) {
+    fb_load_span(fb, layer, 0, y, fb->width, values);
+}
+
+#endif
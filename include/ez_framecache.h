@@ -0,0 +1,248 @@
+#ifndef EZ_FRAMECACHE_H
+#define EZ_FRAMECACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ez_framebuffer.h>
+
+/*
+ * Content addressed cache of finished frames. The caller hashes everything
+ * that determines a frame (scene, camera, render settings) into a key of two
+ * independently seeded 64 bit hashes. The frame is stored under the first as
+ * <directory>/<name>.ezf and the header keeps both, so an entry whose name
+ * collides but whose check differs is a miss. The file is a header followed by
+ * the layers and sample counts exactly as they sit in the framebuffer. A hit
+ * maps the file and copies it into the caller's framebuffer, so the frame can
+ * be exported as if it had just been rendered. Cost and steps are diagnostics
+ * of one particular render and are not kept.
+ *
+ * Entries are written to a unique temporary name and renamed into place, so
+ * several processes can share a directory. A hit touches the entry's
+ * modification time, which makes it the LRU clock: after every store the
+ * oldest entries are deleted until the directory fits the capacity.
+ */
+#define FRAME_CACHE_MAGIC 0x43465a45U
+#define FRAME_CACHE_VERSION 2
+#define FRAME_CACHE_EXTENSION ".ezf"
+#define FRAME_CACHE_PATH_LENGTH 1024
+
+typedef struct {
+    unsigned long long name;
+    unsigned long long check;
+} frame_cache_key_t;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    frame_cache_key_t key;
+    int width;
+    int height;
+    int format;
+    unsigned int reserved;
+} frame_cache_header_t;
+
+typedef struct {
+    char directory[FRAME_CACHE_PATH_LENGTH];
+    size_t capacity;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long stores;
+    unsigned long long evictions;
+    pthread_mutex_t lock;
+} frame_cache_t;
+
+typedef struct {
+    char name[FRAME_CACHE_PATH_LENGTH];
+    size_t size;
+    struct timespec used;
+} frame_cache_entry_t;
+
+frame_cache_key_t frame_cache_key(void) {
+    return (frame_cache_key_t){0xcbf29ce484222325ULL, 0x9e3779b97f4a7c15ULL};
+}
+
+void frame_cache_key_add(frame_cache_key_t *key, const void *data, size_t length) {
+    key->name = fb_hash_bytes(key->name, data, length);
+    key->check = fb_hash_bytes(key->check, data, length);
+}
+
+size_t frame_cache_entry_bytes(framebuffer_t *fb) {
+    size_t bytes = sizeof(frame_cache_header_t) + (size_t)fb->width * fb->height * sizeof(unsigned int);
+    for (int l = 0; l < FB_LAYER_COUNT; l++) {
+        bytes += fb_layer_bytes(fb, (fb_layer)l);
+    }
+    return bytes;
+}
+
+int frame_cache_open(frame_cache_t *cache, const char *directory, size_t capacity) {
+    struct stat info;
+
+    memset(cache, 0, sizeof(*cache));
+    if (snprintf(cache->directory, sizeof(cache->directory), "%s", directory) >= (int)sizeof(cache->directory)) return -1;
+    cache->capacity = capacity;
+    if (mkdir(directory, 0777) != 0 && (stat(directory, &info) != 0 || !S_ISDIR(info.st_mode))) return -1;
+    pthread_mutex_init(&cache->lock, NULL);
+    return 0;
+}
+
+void frame_cache_close(frame_cache_t *cache) {
+    pthread_mutex_destroy(&cache->lock);
+}
+
+int frame_cache_path(frame_cache_t *cache, frame_cache_key_t key, char *path) {
+    int length = snprintf(path, FRAME_CACHE_PATH_LENGTH, "%s/%016llx" FRAME_CACHE_EXTENSION, cache->directory, key.name);
+    return length < FRAME_CACHE_PATH_LENGTH ? 0 : -1;
+}
+
+/* Fills fb from the entry for key; returns -1 on a miss, leaving fb untouched. */
+int frame_cache_load(frame_cache_t *cache, frame_cache_key_t key, framebuffer_t *fb) {
+    char path[FRAME_CACHE_PATH_LENGTH];
+    size_t bytes = frame_cache_entry_bytes(fb);
+    struct stat info;
+    const unsigned char *data;
+    const frame_cache_header_t *header;
+    int valid;
+    int fd;
+
+    fd = frame_cache_path(cache, key, path) == 0 ? open(path, O_RDONLY) : -1;
+    if (fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size != bytes) {
+        if (fd >= 0) close(fd);
+        pthread_mutex_lock(&cache->lock);
+        cache->misses++;
+        pthread_mutex_unlock(&cache->lock);
+        return -1;
+    }
+    data = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        pthread_mutex_lock(&cache->lock);
+        cache->misses++;
+        pthread_mutex_unlock(&cache->lock);
+        return -1;
+    }
+
+    header = (const frame_cache_header_t *)data;
+    valid = header->magic == FRAME_CACHE_MAGIC && header->version == FRAME_CACHE_VERSION &&
+            header->key.name == key.name && header->key.check == key.check &&
+            header->width == fb->width && header->height == fb->height && header->format == (int)fb->format;
+    if (valid) {
+        const unsigned char *at = data + sizeof(frame_cache_header_t);
+        for (int l = 0; l < FB_LAYER_COUNT; l++) {
+            memcpy(fb->layers[l], at, fb_layer_bytes(fb, (fb_layer)l));
+            at += fb_layer_bytes(fb, (fb_layer)l);
+        }
+        memcpy(fb->samples, at, (size_t)fb->width * fb->height * sizeof(unsigned int));
+        memset(fb->cost, 0, (size_t)fb->width * fb->height * sizeof(float));
+        memset(fb->steps, 0, (size_t)fb->width * fb->height * sizeof(float));
+        futimens(fd, NULL);
+    }
+    munmap((void *)data, bytes);
+    close(fd);
+
+    pthread_mutex_lock(&cache->lock);
+    if (valid) cache->hits++;
+    else cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+    return valid ? 0 : -1;
+}
+
+int frame_cache_compare_use(const void *a, const void *b) {
+    const struct timespec *x = &((const frame_cache_entry_t *)a)->used;
+    const struct timespec *y = &((const frame_cache_entry_t *)b)->used;
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/* Deletes least recently used entries until the directory fits the capacity. Call with the lock held. */
+void frame_cache_trim(frame_cache_t *cache) {
+    frame_cache_entry_t *entries = NULL;
+    int count = 0;
+    int capacity = 0;
+    size_t total = 0;
+    struct dirent *entry;
+    DIR *directory = opendir(cache->directory);
+
+    if (directory == NULL) return;
+    while ((entry = readdir(directory)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        size_t extension = strlen(FRAME_CACHE_EXTENSION);
+        char path[FRAME_CACHE_PATH_LENGTH];
+        struct stat info;
+
+        if (length <= extension || strcmp(entry->d_name + length - extension, FRAME_CACHE_EXTENSION) != 0) continue;
+        if (snprintf(path, sizeof(path), "%s/%s", cache->directory, entry->d_name) >= (int)sizeof(path)) continue;
+        if (stat(path, &info) != 0 || !S_ISREG(info.st_mode)) continue;
+        if (count == capacity) {
+            frame_cache_entry_t *grown = realloc(entries, sizeof(frame_cache_entry_t) * (capacity ? capacity * 2 : 64));
+            if (grown == NULL) break;
+            entries = grown;
+            capacity = capacity ? capacity * 2 : 64;
+        }
+        snprintf(entries[count].name, FRAME_CACHE_PATH_LENGTH, "%s", path);
+        entries[count].size = (size_t)info.st_size;
+        entries[count].used = info.st_mtim;
+        total += entries[count].size;
+        count++;
+    }
+    closedir(directory);
+
+    qsort(entries, count, sizeof(frame_cache_entry_t), frame_cache_compare_use);
+    for (int e = 0; e < count && total > cache->capacity; e++) {
+        if (unlink(entries[e].name) == 0) cache->evictions++;
+        total -= entries[e].size;
+    }
+    free(entries);
+}
+
+int frame_cache_store(frame_cache_t *cache, frame_cache_key_t key, framebuffer_t *fb) {
+    char path[FRAME_CACHE_PATH_LENGTH];
+    char temporary[FRAME_CACHE_PATH_LENGTH];
+    frame_cache_header_t header = {FRAME_CACHE_MAGIC, FRAME_CACHE_VERSION, key, fb->width, fb->height, fb->format, 0};
+    size_t samplesBytes = (size_t)fb->width * fb->height * sizeof(unsigned int);
+    int status = 0;
+    FILE *file;
+    int fd;
+
+    if (frame_cache_entry_bytes(fb) > cache->capacity) return -1;
+    if (frame_cache_path(cache, key, path) != 0 ||
+        snprintf(temporary, sizeof(temporary), "%s.XXXXXX", path) >= (int)sizeof(temporary)) {
+        return -1;
+    }
+    fd = mkstemp(temporary);
+    if (fd < 0) return -1;
+    file = fdopen(fd, "wb");
+    if (file == NULL) {
+        close(fd);
+        remove(temporary);
+        return -1;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1) status = -1;
+    for (int l = 0; l < FB_LAYER_COUNT && status == 0; l++) {
+        size_t bytes = fb_layer_bytes(fb, (fb_layer)l);
+        if (fwrite(fb->layers[l], 1, bytes, file) != bytes) status = -1;
+    }
+    if (status == 0 && fwrite(fb->samples, 1, samplesBytes, file) != samplesBytes) status = -1;
+    if (fclose(file) != 0) status = -1;
+
+    if (status == 0 && rename(temporary, path) != 0) status = -1;
+    if (status != 0) {
+        remove(temporary);
+        return -1;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stores++;
+    frame_cache_trim(cache);
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+}
+
+#endif
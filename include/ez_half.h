@@ -0,0 +1,136 @@
+#ifndef EZ_HALF_H
+#define EZ_HALF_H
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define EZ_HALF_X86 1
+#endif
+
+/*
+ * IEEE 754 binary16 storage. Conversions round to nearest even, so a single
+ * float -> half -> float round trip has a relative error of at most 2^-11
+ * (~0.049%) for normal values in [6.1e-5, 65504]; below that the absolute
+ * error is at most 2^-25. Values above 65504 become infinity.
+ */
+typedef unsigned short half;
+
+typedef union {
+    unsigned int u;
+    float f;
+} half_bits;
+
+half half_from_float(float value) {
+    half_bits f = { 0 };
+    half_bits infinity = { 255u << 23 };
+    half_bits halfMax = { (127u + 16u) << 23 };
+    half_bits denormMagic = { ((127u - 15u) + (23u - 10u) + 1u) << 23 };
+    unsigned int sign;
+    unsigned int out;
+
+    f.f = value;
+    sign = f.u & 0x80000000u;
+    f.u ^= sign;
+
+    if (f.u >= halfMax.u) {
+        out = f.u > infinity.u ? 0x7e00 : 0x7c00;
+    } else if (f.u < (113u << 23)) {
+        f.f += denormMagic.f;
+        out = f.u - denormMagic.u;
+    } else {
+        unsigned int mantOdd = (f.u >> 13) & 1;
+        f.u += ((unsigned int)(15 - 127) << 23) + 0xfff;
+        f.u += mantOdd;
+        out = f.u >> 13;
+    }
+
+    return (half)(out | (sign >> 16));
+}
+
+float half_to_float(half value) {
+    half_bits magic = { 113u << 23 };
+    unsigned int shiftedExp = 0x7c00u << 13;
+    half_bits o;
+    unsigned int exp;
+
+    o.u = (unsigned int)(value & 0x7fff) << 13;
+    exp = shiftedExp & o.u;
+    o.u += (127u - 15u) << 23;
+
+    if (exp == shiftedExp) {
+        o.u += (128u - 16u) << 23;
+    } else if (exp == 0) {
+        o.u += 1u << 23;
+        o.f -= magic.f;
+    }
+
+    o.u |= (unsigned int)(value & 0x8000) << 16;
+    return o.f;
+}
+
+#ifdef EZ_HALF_X86
+__attribute__((target("f16c")))
+void half_from_float_n_f16c(half *dst, const float *src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i packed = _mm_cvtps_ph(_mm_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storel_epi64((__m128i *)(dst + i), packed);
+    }
+    for (; i < n; i++) {
+        dst[i] = half_from_float(src[i]);
+    }
+}
+
+__attribute__((target("f16c")))
+void half_to_float_n_f16c(float *dst, const half *src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i packed = _mm_loadl_epi64((const __m128i *)(src + i));
+        _mm_storeu_ps(dst + i, _mm_cvtph_ps(packed));
+    }
+    for (; i < n; i++) {
+        dst[i] = half_to_float(src[i]);
+    }
+}
+#endif
+
+int half_has_f16c() {
+#ifdef EZ_HALF_X86
+    static int supported = -1;
+    if (supported < 0) {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("f16c") ? 1 : 0;
+    }
+    return supported;
+#else
+    return 0;
+#endif
+}
+
+void half_from_float_n(half *dst, const float *src, size_t n) {
+#ifdef EZ_HALF_X86
+    if (half_has_f16c()) {
+        half_from_float_n_f16c(dst, src, n);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = half_from_float(src[i]);
+    }
+}
+
+void half_to_float_n(float *dst, const half *src, size_t n) {
+#ifdef EZ_HALF_X86
+    if (half_has_f16c()) {
+        half_to_float_n_f16c(dst, src, n);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = half_to_float(src[i]);
+    }
+}
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef EZ_HDR_H
+#define EZ_HDR_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ez_framebuffer.h>
+#include <ez_deflate.h>
+#include <ez_stream.h>
+
+/*
+ * Float image export. PFM carries the beauty layer only; EXR files are tiled
+ * (ONE_LEVEL, 64x64) and carry every framebuffer layer as named channels in
+ * the framebuffer's own precision, optionally ZIP compressed per tile.
+ */
+#define EXR_TILE_SIZE 64
+#define EXR_MAX_CHANNELS 16
+
+typedef enum {
+    EXR_COMPRESSION_NONE = 0,
+    EXR_COMPRESSION_ZIP = 3
+} exr_compression;
+
+typedef struct {
+    const char *name;
+    fb_layer layer;
+    int component;
+} exr_channel_t;
+
+int exr_channel_compare(const void *a, const void *b) {
+    return strcmp(((const exr_channel_t *)a)->name, ((const exr_channel_t *)b)->name);
+}
+
+int exr_channels(exr_channel_t *channels) {
+    static const exr_channel_t all[] = {
+        {"R", FB_LAYER_BEAUTY, 0}, {"G", FB_LAYER_BEAUTY, 1}, {"B", FB_LAYER_BEAUTY, 2},
+        {"albedo.R", FB_LAYER_ALBEDO, 0}, {"albedo.G", FB_LAYER_ALBEDO, 1}, {"albedo.B", FB_LAYER_ALBEDO, 2},
+        {"N.X", FB_LAYER_NORMAL, 0}, {"N.Y", FB_LAYER_NORMAL, 1}, {"N.Z", FB_LAYER_NORMAL, 2},
+        {"Z", FB_LAYER_DEPTH, 0},
+        {"variance.Y", FB_LAYER_VARIANCE, 0},
+    };
+    int count = sizeof(all) / sizeof(all[0]);
+
+    memcpy(channels, all, sizeof(all));
+    qsort(channels, count, sizeof(exr_channel_t), exr_channel_compare);
+    return count;
+}
+
+void exr_attribute(FILE *file, const char *name, const char *type, const void *value, int size) {
+    fwrite(name, 1, strlen(name) + 1, file);
+    fwrite(type, 1, strlen(type) + 1, file);
+    fwrite(&size, 4, 1, file);
+    fwrite(value, 1, size, file);
+}
+
+void exr_header(FILE *file, framebuffer_t *fb, exr_channel_t *channels, int count, exr_compression compression) {
+    const unsigned char magic[8] = {0x76, 0x2f, 0x31, 0x01, 0x02, 0x02, 0x00, 0x00};
+    unsigned char chlist[EXR_MAX_CHANNELS * 32];
+    int pixelType = fb->format == FB_FLOAT16 ? 1 : 2;
+    int window[4] = {0, 0, fb->width - 1, fb->height - 1};
+    unsigned int tiles[2] = {EXR_TILE_SIZE, EXR_TILE_SIZE};
+    unsigned char tileDesc[9];
+    unsigned char compressionByte = (unsigned char)compression;
+    unsigned char lineOrder = 0;
+    float one = 1;
+    float center[2] = {0, 0};
+    int length = 0;
+
+    for (int c = 0; c < count; c++) {
+        int sampling[2] = {1, 1};
+        size_t nameLength = strlen(channels[c].name) + 1;
+        memcpy(chlist + length, channels[c].name, nameLength);
+        length += (int)nameLength;
+        memcpy(chlist + length, &pixelType, 4);
+        memset(chlist + length + 4, 0, 4);
+        memcpy(chlist + length + 8, sampling, 8);
+        length += 16;
+    }
+    chlist[length++] = 0;
+
+    memcpy(tileDesc, tiles, 8);
+    tileDesc[8] = 0;
+
+    fwrite(magic, 1, 8, file);
+    exr_attribute(file, "channels", "chlist", chlist, length);
+    exr_attribute(file, "compression", "compression", &compressionByte, 1);
+    exr_attribute(file, "dataWindow", "box2i", window, 16);
+    exr_attribute(file, "displayWindow", "box2i", window, 16);
+    exr_attribute(file, "lineOrder", "lineOrder", &lineOrder, 1);
+    exr_attribute(file, "pixelAspectRatio", "float", &one, 4);
+    exr_attribute(file, "screenWindowCenter", "v2f", center, 8);
+    exr_attribute(file, "screenWindowWidth", "float", &one, 4);
+    exr_attribute(file, "tiles", "tiledesc", tileDesc, 9);
+    fputc(0, file);
+}
+
+size_t exr_zip(const unsigned char *data, size_t length, unsigned char *scratch, deflate_t *deflate) {
+    const unsigned char *stop = data + length;
+    unsigned char *t1 = scratch;
+    unsigned char *t2 = scratch + (length + 1) / 2;
+    unsigned int adler;
+    int previous;
+
+    while (data < stop) {
+        *t1++ = *data++;
+        if (data < stop) *t2++ = *data++;
+    }
+
+    previous = scratch[0];
+    for (size_t i = 1; i < length; i++) {
+        int value = scratch[i];
+        scratch[i] = (unsigned char)(value - previous + 128 + 256);
+        previous = value;
+    }
+
+    deflate_drain(deflate);
+    deflate_reserve(deflate, 2);
+    if (!deflate->failed) {
+        deflate->out[0] = 0x78;
+        deflate->out[1] = 0x01;
+        deflate->outLength = 2;
+    }
+    adler = adler32_update(1, scratch, length);
+    deflate_write(deflate, scratch, length);
+    deflate_finish(deflate);
+    deflate_reserve(deflate, 4);
+    if (deflate->failed) return 0;
+    stream_put_u32(deflate->out + deflate->outLength, adler);
+    deflate->outLength += 4;
+    return deflate->outLength;
+}
+
+int exr_write(framebuffer_t *fb, const char *path, exr_compression compression) {
+    exr_channel_t channels[EXR_MAX_CHANNELS];
+    int count = exr_channels(channels);
+    int columns = (fb->width + EXR_TILE_SIZE - 1) / EXR_TILE_SIZE;
+    int rows = (fb->height + EXR_TILE_SIZE - 1) / EXR_TILE_SIZE;
+    size_t valueSize = fb_format_size(fb->format);
+    size_t tileBytes = (size_t)EXR_TILE_SIZE * EXR_TILE_SIZE * count * valueSize;
+    unsigned long long *offsets = calloc((size_t)columns * rows, sizeof(unsigned long long));
+    unsigned char *tile = malloc(tileBytes);
+    unsigned char *scratch = malloc(tileBytes);
+    float *span = malloc(sizeof(float) * 3 * EXR_TILE_SIZE);
+    float *plane = malloc(sizeof(float) * EXR_TILE_SIZE);
+    size_t buffers = sizeof(unsigned long long) * columns * rows + 2 * tileBytes + sizeof(float) * 4 * EXR_TILE_SIZE;
+    deflate_t deflate;
+    off_t tableOffset;
+    int status = 0;
+    FILE *file;
+
+    if (offsets == NULL || tile == NULL || scratch == NULL || span == NULL || plane == NULL ||
+        deflate_init(&deflate) != 0) {
+        free(offsets); free(tile); free(scratch); free(span); free(plane);
+        return -1;
+    }
+    memory_add(MEMORY_OUTPUT, buffers);
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        status = -1;
+        goto done;
+    }
+
+    exr_header(file, fb, channels, count, compression);
+    tableOffset = ftello(file);
+    fwrite(offsets, sizeof(unsigned long long), (size_t)columns * rows, file);
+
+    for (int ty = 0; ty < rows; ty++) {
+        for (int tx = 0; tx < columns; tx++) {
+            int x0 = tx * EXR_TILE_SIZE;
+            int y0 = ty * EXR_TILE_SIZE;
+            int w = fb->width - x0 < EXR_TILE_SIZE ? fb->width - x0 : EXR_TILE_SIZE;
+            int h = fb->height - y0 < EXR_TILE_SIZE ? fb->height - y0 : EXR_TILE_SIZE;
+            unsigned char *out = tile;
+            int header[5] = {tx, ty, 0, 0, 0};
+            size_t rawBytes;
+            size_t packed;
+
+            for (int y = y0; y < y0 + h; y++) {
+                for (int c = 0; c < count; c++) {
+                    int stride = fb_layer_channels(channels[c].layer);
+                    fb_load_span(fb, channels[c].layer, x0, y, w, span);
+                    for (int x = 0; x < w; x++) plane[x] = span[x * stride + channels[c].component];
+                    if (fb->format == FB_FLOAT16) {
+                        half_from_float_n((half *)out, plane, w);
+                    } else {
+                        memcpy(out, plane, sizeof(float) * w);
+                    }
+                    out += valueSize * w;
+                }
+            }
+
+            rawBytes = out - tile;
+            offsets[ty * columns + tx] = (unsigned long long)ftello(file);
+            packed = compression == EXR_COMPRESSION_ZIP ? exr_zip(tile, rawBytes, scratch, &deflate) : 0;
+            if (packed > 0 && packed < rawBytes) {
+                header[4] = (int)packed;
+                fwrite(header, 4, 5, file);
+                fwrite(deflate.out, 1, packed, file);
+            } else {
+                header[4] = (int)rawBytes;
+                fwrite(header, 4, 5, file);
+                fwrite(tile, 1, rawBytes, file);
+            }
+        }
+    }
+
+    if (fseeko(file, tableOffset, SEEK_SET) != 0 ||
+        fwrite(offsets, sizeof(unsigned long long), (size_t)columns * rows, file) != (size_t)columns * rows) {
+        status = -1;
+    }
+    if (ferror(file)) status = -1;
+    if (fclose(file) != 0) status = -1;
+
+done:
+    deflate_destroy(&deflate);
+    memory_add(MEMORY_OUTPUT, -(long long)buffers);
+    free(offsets);
+    free(tile);
+    free(scratch);
+    free(span);
+    free(plane);
+    return status;
+}
+
+int pfm_write(framebuffer_t *fb, const char *path) {
+    stream_writer_t writer;
+    float *row = malloc(sizeof(float) * 3 * fb->width);
+    int status = 0;
+
+    if (row == NULL) return -1;
+    if (stream_open(&writer, path, fb->width, fb->height) != 0) {
+        if (writer.file != NULL) stream_close(&writer);
+        free(row);
+        return -1;
+    }
+
+    for (int y = 0; y < fb->height && status == 0; y++) {
+        fb_load_row(fb, FB_LAYER_BEAUTY, y, row);
+        status = stream_write_rows(&writer, row, 1);
+    }
+    if (stream_close(&writer) != 0) status = -1;
+    free(row);
+    return status;
+}
+
+int hdr_write(framebuffer_t *fb, const char *path, exr_compression compression) {
+    const char *extension = strrchr(path, '.');
+    if (extension != NULL && strcasecmp(extension, ".exr") == 0) {
+        return exr_write(fb, path, compression);
+    }
+    return pfm_write(fb, path);
+}
+
+#endif
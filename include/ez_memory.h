@@ -0,0 +1,69 @@
+#ifndef EZ_MEMORY_H
+#define EZ_MEMORY_H
+
+#include <stdatomic.h>
+
+/*
+ * Byte accounting per subsystem. Modules report what they allocate, map or
+ * release with memory_add (negative to release) right where the size is
+ * known, so allocation itself stays plain malloc / mmap. Current and peak
+ * values are kept per category and for the total; the peak of the total is
+ * the high-water mark of the whole process, not the sum of category peaks.
+ * Mapped file data counts in full even though the kernel may page it lazily.
+ */
+typedef enum {
+    MEMORY_GEOMETRY,
+    MEMORY_ACCELERATION,
+    MEMORY_FRAMEBUFFER,
+    MEMORY_TEXTURE,
+    MEMORY_QUEUE,
+    MEMORY_OUTPUT,
+    MEMORY_CATEGORY_COUNT
+} memory_category;
+
+typedef struct {
+    long long current[MEMORY_CATEGORY_COUNT];
+    long long peak[MEMORY_CATEGORY_COUNT];
+    long long total;
+    long long totalPeak;
+} memory_usage_t;
+
+const char *memoryCategoryNames[MEMORY_CATEGORY_COUNT] = {
+    "geometry", "acceleration", "framebuffers", "textures", "queues", "output"
+};
+
+atomic_llong memoryCurrent[MEMORY_CATEGORY_COUNT];
+atomic_llong memoryPeak[MEMORY_CATEGORY_COUNT];
+atomic_llong memoryTotal;
+atomic_llong memoryTotalPeak;
+
+void memory_raise_peak(atomic_llong *peak, long long value) {
+    long long seen = atomic_load(peak);
+    while (value > seen && !atomic_compare_exchange_weak(peak, &seen, value)) {
+    }
+}
+
+void memory_add(memory_category category, long long bytes) {
+    long long current = atomic_fetch_add(&memoryCurrent[category], bytes) + bytes;
+    long long total = atomic_fetch_add(&memoryTotal, bytes) + bytes;
+
+    if (bytes > 0) {
+        memory_raise_peak(&memoryPeak[category], current);
+        memory_raise_peak(&memoryTotalPeak, total);
+    }
+}
+
+long long memory_total() {
+    return atomic_load(&memoryTotal);
+}
+
+void memory_usage(memory_usage_t *usage) {
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        usage->current[c] = atomic_load(&memoryCurrent[c]);
+        usage->peak[c] = atomic_load(&memoryPeak[c]);
+    }
+    usage->total = atomic_load(&memoryTotal);
+    usage->totalPeak = atomic_load(&memoryTotalPeak);
+}
+
+#endif
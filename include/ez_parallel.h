@@ -0,0 +1,71 @@
+#ifndef EZ_PARALLEL_H
+#define EZ_PARALLEL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define PARALLEL_MAX_THREADS 256
+
+typedef void (*parallel_fn)(void *ctx, int index, int thread);
+
+typedef struct {
+    parallel_fn fn;
+    void *ctx;
+    int count;
+    atomic_int next;
+} parallel_job_t;
+
+typedef struct {
+    parallel_job_t *job;
+    int thread;
+} parallel_worker_t;
+
+int parallel_default_threads() {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online < 1) return 1;
+    return online > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : (int)online;
+}
+
+void *parallel_worker(void *arg) {
+    parallel_worker_t *worker = (parallel_worker_t *)arg;
+    parallel_job_t *job = worker->job;
+
+    for (;;) {
+        int index = atomic_fetch_add(&job->next, 1);
+        if (index >= job->count) break;
+        job->fn(job->ctx, index, worker->thread);
+    }
+    return NULL;
+}
+
+void parallel_for(int count, int threads, parallel_fn fn, void *ctx) {
+    parallel_job_t job;
+    parallel_worker_t workers[PARALLEL_MAX_THREADS];
+    pthread_t handles[PARALLEL_MAX_THREADS];
+    int started = 1;
+
+    if (threads < 1) threads = 1;
+    if (threads > PARALLEL_MAX_THREADS) threads = PARALLEL_MAX_THREADS;
+    if (threads > count) threads = count > 0 ? count : 1;
+
+    job.fn = fn;
+    job.ctx = ctx;
+    job.count = count;
+    atomic_init(&job.next, 0);
+
+    for (int t = 0; t < threads; t++) {
+        workers[t] = (parallel_worker_t){&job, t};
+    }
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&handles[t], NULL, parallel_worker, &workers[t]) != 0) break;
+        started++;
+    }
+    parallel_worker(&workers[0]);
+    for (int t = 1; t < started; t++) {
+        pthread_join(handles[t], NULL);
+    }
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef EZ_PERF_H
+#define EZ_PERF_H
+
+#include <string.h>
+
+/*
+ * Hardware counters through perf_event_open (Linux only; perf_open fails
+ * everywhere else). Counters are per event rather than grouped so that they
+ * can be inherited: opened with inherit set, they also count every thread the
+ * caller starts afterwards, and a joined thread's counts are folded in by the
+ * time it has exited. Values are scaled by enabled / running time in case the
+ * PMU had to multiplex them. Events the CPU or kernel refuse are skipped and
+ * reported as missing.
+ */
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_EVENT_COUNT
+} perf_event;
+
+typedef struct {
+    int fd[PERF_EVENT_COUNT];
+} perf_counters_t;
+
+typedef struct {
+    unsigned long long value[PERF_EVENT_COUNT];
+    int valid[PERF_EVENT_COUNT];
+} perf_sample_t;
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+int perf_open_event(perf_event event, int inherit) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = inherit;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (event) {
+    case PERF_CYCLES:
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_INSTRUCTIONS:
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PERF_LLC_MISSES:
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    default:
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Counts the calling thread, plus the threads it creates later when inherit is set. */
+int perf_open(perf_counters_t *counters, int inherit) {
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        counters->fd[e] = perf_open_event((perf_event)e, inherit);
+    }
+    if (counters->fd[PERF_CYCLES] < 0 || counters->fd[PERF_INSTRUCTIONS] < 0) {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (counters->fd[e] >= 0) close(counters->fd[e]);
+            counters->fd[e] = -1;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+void perf_read(perf_counters_t *counters, perf_sample_t *sample) {
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        unsigned long long data[3];
+
+        sample->value[e] = 0;
+        sample->valid[e] = 0;
+        if (counters->fd[e] < 0 || read(counters->fd[e], data, sizeof(data)) != sizeof(data)) continue;
+        sample->value[e] = data[2] > 0 && data[2] < data[1] ? (unsigned long long)((double)data[0] * data[1] / data[2])
+                                                            : data[0];
+        sample->valid[e] = data[2] > 0;
+    }
+}
+
+void perf_close(perf_counters_t *counters) {
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        if (counters->fd[e] >= 0) close(counters->fd[e]);
+        counters->fd[e] = -1;
+    }
+}
+
+#else
+
+int perf_open(perf_counters_t *counters, int inherit) {
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) counters->fd[e] = -1;
+    return -1;
+}
+
+void perf_read(perf_counters_t *counters, perf_sample_t *sample) {
+    memset(sample, 0, sizeof(*sample));
+}
+
+void perf_close(perf_counters_t *counters) {
+}
+
+#endif
+
+perf_sample_t perf_delta(const perf_sample_t *before, const perf_sample_t *after) {
+    perf_sample_t delta;
+    for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+        delta.valid[e] = before->valid[e] && after->valid[e];
+        delta.value[e] = delta.valid[e] && after->value[e] > before->value[e] ? after->value[e] - before->value[e] : 0;
+    }
+    return delta;
+}
+
+#endif
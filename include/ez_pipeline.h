@@ -0,0 +1,129 @@
+#ifndef EZ_PIPELINE_H
+#define EZ_PIPELINE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <ez_framebuffer.h>
+#include <ez_queue.h>
+
+/*
+ * Export pipeline for frame sequences. A fixed set of framebuffers cycles
+ * between the renderer and a pool of I/O threads: pipeline_acquire() blocks
+ * until a buffer is free, which is the backpressure that keeps a slow disk
+ * from queueing unbounded frames. With one I/O thread and a depth of one the
+ * renderer is simply double buffered.
+ */
+#define PIPELINE_MAX_THREADS 16
+
+typedef int (*pipeline_fn)(void *ctx, framebuffer_t *fb, int frame);
+
+typedef struct {
+    framebuffer_t fb;
+    int frame;
+} pipeline_slot_t;
+
+typedef struct {
+    pipeline_slot_t *slots;
+    int slotCount;
+    queue_t free;
+    queue_t pending;
+    pthread_t threads[PIPELINE_MAX_THREADS];
+    int threadCount;
+    pipeline_fn fn;
+    void *ctx;
+    atomic_int failures;
+} pipeline_t;
+
+void *pipeline_worker(void *arg) {
+    pipeline_t *pipeline = (pipeline_t *)arg;
+    pipeline_slot_t *slot;
+
+    while ((slot = (pipeline_slot_t *)queue_pop(&pipeline->pending)) != NULL) {
+        if (pipeline->fn(pipeline->ctx, &slot->fb, slot->frame) != 0) {
+            atomic_fetch_add(&pipeline->failures, 1);
+        }
+        queue_push(&pipeline->free, slot);
+    }
+    return NULL;
+}
+
+void pipeline_release(pipeline_t *pipeline) {
+    for (int s = 0; s < pipeline->slotCount; s++) {
+        fb_destroy(&pipeline->slots[s].fb);
+    }
+    free(pipeline->slots);
+    pipeline->slots = NULL;
+}
+
+int pipeline_create(pipeline_t *pipeline, int width, int height, fb_format format,
+                    int threads, int depth, pipeline_fn fn, void *ctx) {
+    if (threads < 1) threads = 1;
+    if (threads > PIPELINE_MAX_THREADS) threads = PIPELINE_MAX_THREADS;
+    if (depth < 1) depth = 1;
+
+    pipeline->fn = fn;
+    pipeline->ctx = ctx;
+    pipeline->threadCount = 0;
+    pipeline->slotCount = threads + depth;
+    atomic_init(&pipeline->failures, 0);
+    pipeline->slots = calloc(pipeline->slotCount, sizeof(pipeline_slot_t));
+    if (pipeline->slots == NULL) return -1;
+
+    if (queue_init(&pipeline->free, pipeline->slotCount) != 0) {
+        free(pipeline->slots);
+        return -1;
+    }
+    if (queue_init(&pipeline->pending, pipeline->slotCount) != 0) {
+        queue_destroy(&pipeline->free);
+        free(pipeline->slots);
+        return -1;
+    }
+
+    for (int s = 0; s < pipeline->slotCount; s++) {
+        if (fb_create(&pipeline->slots[s].fb, width, height, format) != 0) {
+            queue_destroy(&pipeline->free);
+            queue_destroy(&pipeline->pending);
+            pipeline_release(pipeline);
+            return -1;
+        }
+        queue_push(&pipeline->free, &pipeline->slots[s]);
+    }
+
+    for (int t = 0; t < threads; t++) {
+        if (pthread_create(&pipeline->threads[t], NULL, pipeline_worker, pipeline) != 0) break;
+        pipeline->threadCount++;
+    }
+    if (pipeline->threadCount == 0) {
+        queue_destroy(&pipeline->free);
+        queue_destroy(&pipeline->pending);
+        pipeline_release(pipeline);
+        return -1;
+    }
+    return 0;
+}
+
+pipeline_slot_t *pipeline_acquire(pipeline_t *pipeline) {
+    return (pipeline_slot_t *)queue_pop(&pipeline->free);
+}
+
+void pipeline_submit(pipeline_t *pipeline, pipeline_slot_t *slot, int frame) {
+    slot->frame = frame;
+    queue_push(&pipeline->pending, slot);
+}
+
+int pipeline_destroy(pipeline_t *pipeline) {
+    int failures;
+
+    queue_close(&pipeline->pending);
+    for (int t = 0; t < pipeline->threadCount; t++) {
+        pthread_join(pipeline->threads[t], NULL);
+    }
+    failures = atomic_load(&pipeline->failures);
+    queue_destroy(&pipeline->free);
+    queue_destroy(&pipeline->pending);
+    pipeline_release(pipeline);
+    return failures;
+}
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef EZ_PROFILE_H
+#define EZ_PROFILE_H
+
+#include <stdio.h>
+
+/*
+ * Scoped timing zones, compiled in only with -DEZ_PROFILE (make profile).
+ *
+ *   PROFILE_ZONE("tile");            timeline event for the enclosing scope
+ *   PROFILE_COUNT(PROFILE_SHADE);    charges the enclosing scope's time to a
+ *                                    per-thread stage counter
+ *
+ * Zones land in a per-thread ring buffer of the most recent events; each
+ * event also carries how much of its time went to every stage counter, so
+ * fine-grained work such as single rays never needs an event of its own.
+ * Counted scopes nest exclusively: a shadow ray's intersection inside shading
+ * is charged to intersection only.
+ * Rings are handed back to a pool when a thread exits and reused by the next
+ * one. profile_write_chrome dumps all rings as Chrome / Perfetto trace JSON.
+ * Timestamps come from rdtsc on x86 and CLOCK_MONOTONIC elsewhere.
+ */
+typedef enum {
+    PROFILE_RAYGEN,
+    PROFILE_INTERSECT,
+    PROFILE_SHADE,
+    PROFILE_COUNTER_COUNT
+} profile_counter;
+
+#ifdef EZ_PROFILE
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define PROFILE_RING_SIZE 65536
+
+typedef struct {
+    const char *name;
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long counters[PROFILE_COUNTER_COUNT];
+} profile_event_t;
+
+typedef struct profile_ring_s {
+    int id;
+    unsigned long long written;
+    unsigned long long counters[PROFILE_COUNTER_COUNT];
+    int active;
+    unsigned long long activeStart;
+    struct profile_ring_s *nextFree;
+    struct profile_ring_s *nextAll;
+    profile_event_t events[PROFILE_RING_SIZE];
+} profile_ring_t;
+
+typedef struct {
+    const char *name;
+    unsigned long long start;
+    unsigned long long counters[PROFILE_COUNTER_COUNT];
+} profile_zone_t;
+
+typedef struct {
+    int previous;
+} profile_span_t;
+
+pthread_mutex_t profileLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_once_t profileOnce = PTHREAD_ONCE_INIT;
+pthread_key_t profileKey;
+profile_ring_t *profileRings = NULL;
+profile_ring_t *profileFree = NULL;
+int profileRingCount = 0;
+unsigned long long profileEpochTicks;
+double profileEpochSeconds;
+__thread profile_ring_t *profileRing = NULL;
+
+static inline unsigned long long profile_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+double profile_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void profile_release(void *arg) {
+    profile_ring_t *ring = (profile_ring_t *)arg;
+    pthread_mutex_lock(&profileLock);
+    ring->nextFree = profileFree;
+    profileFree = ring;
+    pthread_mutex_unlock(&profileLock);
+}
+
+void profile_init() {
+    pthread_key_create(&profileKey, profile_release);
+    profileEpochTicks = profile_ticks();
+    profileEpochSeconds = profile_seconds();
+}
+
+profile_ring_t *profile_ring() {
+    if (profileRing != NULL) return profileRing;
+
+    pthread_once(&profileOnce, profile_init);
+    pthread_mutex_lock(&profileLock);
+    if (profileFree != NULL) {
+        profileRing = profileFree;
+        profileFree = profileFree->nextFree;
+    } else {
+        profileRing = calloc(1, sizeof(profile_ring_t));
+        if (profileRing != NULL) {
+            profileRing->id = profileRingCount++;
+            profileRing->active = -1;
+            profileRing->nextAll = profileRings;
+            profileRings = profileRing;
+        }
+    }
+    pthread_mutex_unlock(&profileLock);
+    if (profileRing != NULL) pthread_setspecific(profileKey, profileRing);
+    return profileRing;
+}
+
+static inline profile_zone_t profile_zone_begin(const char *name) {
+    profile_ring_t *ring = profile_ring();
+    profile_zone_t zone = {name, 0, {0}};
+    if (ring != NULL) memcpy(zone.counters, ring->counters, sizeof(zone.counters));
+    zone.start = profile_ticks();
+    return zone;
+}
+
+static inline void profile_zone_end(profile_zone_t *zone) {
+    unsigned long long end = profile_ticks();
+    profile_ring_t *ring = profileRing;
+    profile_event_t *event;
+
+    if (ring == NULL) return;
+    event = &ring->events[ring->written++ % PROFILE_RING_SIZE];
+    event->name = zone->name;
+    event->start = zone->start;
+    event->end = end;
+    for (int c = 0; c < PROFILE_COUNTER_COUNT; c++) {
+        event->counters[c] = ring->counters[c] - zone->counters[c];
+    }
+}
+
+static inline void profile_switch(profile_ring_t *ring, int counter) {
+    unsigned long long now = profile_ticks();
+    if (ring->active >= 0) ring->counters[ring->active] += now - ring->activeStart;
+    ring->active = counter;
+    ring->activeStart = now;
+}
+
+static inline profile_span_t profile_span_begin(int counter) {
+    profile_ring_t *ring = profile_ring();
+    profile_span_t span = {-1};
+    if (ring != NULL) {
+        span.previous = ring->active;
+        profile_switch(ring, counter);
+    }
+    return span;
+}
+
+static inline void profile_span_end(profile_span_t *span) {
+    if (profileRing != NULL) profile_switch(profileRing, span->previous);
+}
+
+int profile_write_chrome(const char *path) {
+    static const char *counterNames[PROFILE_COUNTER_COUNT] = {"raygen_us", "intersect_us", "shade_us"};
+    double ticksPerMicrosecond;
+    int first = 1;
+    FILE *file;
+
+    pthread_once(&profileOnce, profile_init);
+    ticksPerMicrosecond = (profile_ticks() - profileEpochTicks) / ((profile_seconds() - profileEpochSeconds) * 1e6);
+    if (ticksPerMicrosecond <= 0) ticksPerMicrosecond = 1;
+
+    file = fopen(path, "w");
+    if (file == NULL) return -1;
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+    pthread_mutex_lock(&profileLock);
+    for (profile_ring_t *ring = profileRings; ring != NULL; ring = ring->nextAll) {
+        unsigned long long count = ring->written < PROFILE_RING_SIZE ? ring->written : PROFILE_RING_SIZE;
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+                first ? "" : ",\n", ring->id, ring->id == 0 ? "main" : "worker", ring->id);
+        first = 0;
+        for (unsigned long long e = ring->written - count; e < ring->written; e++) {
+            profile_event_t *event = &ring->events[e % PROFILE_RING_SIZE];
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+                    event->name, ring->id, (double)(long long)(event->start - profileEpochTicks) / ticksPerMicrosecond,
+                    (event->end - event->start) / ticksPerMicrosecond);
+            for (int c = 0; c < PROFILE_COUNTER_COUNT; c++) {
+                fprintf(file, "%s\"%s\":%.3f", c ? "," : "", counterNames[c], event->counters[c] / ticksPerMicrosecond);
+            }
+            fputs("}}", file);
+        }
+    }
+    pthread_mutex_unlock(&profileLock);
+    fputs("\n]}\n", file);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) \
+    profile_zone_t PROFILE_CONCAT(profileZone, __LINE__) __attribute__((cleanup(profile_zone_end))) = profile_zone_begin(name)
+#define PROFILE_COUNT(counter) \
+    profile_span_t PROFILE_CONCAT(profileSpan, __LINE__) __attribute__((cleanup(profile_span_end))) = profile_span_begin(counter)
+
+#else
+
+#define PROFILE_ZONE(name) do {} while (0)
+#define PROFILE_COUNT(counter) do {} while (0)
+
+int profile_write_chrome(const char *path) {
+    (void)path;
+    return -1;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef EZ_QUEUE_H
+#define EZ_QUEUE_H
+
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * Bounded blocking FIFO. queue_push() waits while the queue is full, which is
+ * how producers feel backpressure from slower consumers.
+ */
+typedef struct {
+    void **items;
+    int capacity;
+    int head;
+    int count;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+} queue_t;
+
+int queue_init(queue_t *queue, int capacity) {
+    if (capacity < 1) capacity = 1;
+    queue->items = calloc(capacity, sizeof(void *));
+    if (queue->items == NULL) return -1;
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    queue->closed = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->notEmpty, NULL);
+    pthread_cond_init(&queue->notFull, NULL);
+    return 0;
+}
+
+void queue_destroy(queue_t *queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->notEmpty);
+    pthread_cond_destroy(&queue->notFull);
+    free(queue->items);
+    queue->items = NULL;
+}
+
+int queue_push(queue_t *queue, void *item) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->capacity && !queue->closed) {
+        pthread_cond_wait(&queue->notFull, &queue->lock);
+    }
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+void *queue_pop(queue_t *queue) {
+    void *item = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->notEmpty, &queue->lock);
+    }
+    if (queue->count > 0) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->notFull);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+void queue_close(queue_t *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->notEmpty);
+    pthread_cond_broadcast(&queue->notFull);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef EZ_RANDOM_H
+#define EZ_RANDOM_H
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Counter based random numbers (Philox4x32-10). Each draw is a pure function
+ * of its counter, (pixel, sample, bounce, block), and a 64 bit key, so threads
+ * share no state and a sample gets the same numbers however the work is
+ * split. One draw yields four 32 bit values; block selects the next four
+ * dimensions of the same sample and bounce.
+ *
+ * random_draw_packet runs RANDOM_PACKET counters side by side, one per SSE2
+ * lane where available, and produces the same values as RANDOM_PACKET calls
+ * to random_draw.
+ */
+#define RANDOM_PACKET 4
+#define RANDOM_ROUNDS 10
+#define RANDOM_M0 0xd2511f53U
+#define RANDOM_M1 0xcd9e8d57U
+#define RANDOM_W0 0x9e3779b9U
+#define RANDOM_W1 0xbb67ae85U
+#define RANDOM_KEY 0x2545f491U
+
+typedef struct {
+    unsigned int v[4];
+} random_block_t;
+
+random_block_t random_draw(unsigned int seed, unsigned int pixel, unsigned int sample, unsigned int bounce,
+                           unsigned int block) {
+    unsigned int c0 = pixel, c1 = sample, c2 = bounce, c3 = block;
+    unsigned int k0 = seed, k1 = RANDOM_KEY;
+
+    for (int r = 0; r < RANDOM_ROUNDS; r++) {
+        unsigned long long p0 = (unsigned long long)RANDOM_M0 * c0;
+        unsigned long long p1 = (unsigned long long)RANDOM_M1 * c2;
+
+        c0 = (unsigned int)(p1 >> 32) ^ c1 ^ k0;
+        c1 = (unsigned int)p1;
+        c2 = (unsigned int)(p0 >> 32) ^ c3 ^ k1;
+        c3 = (unsigned int)p0;
+        k0 += RANDOM_W0;
+        k1 += RANDOM_W1;
+    }
+    return (random_block_t){{c0, c1, c2, c3}};
+}
+
+/* Uniform in [0, 1) from the top 24 bits, so the result never rounds up to 1. */
+float random_unit(unsigned int bits) {
+    return (bits >> 8) * (1.0f / 16777216.0f);
+}
+
+#ifdef __SSE2__
+/* Low and high halves of the 32x32 bit products of every lane with m. */
+void random_mul(__m128i a, unsigned int m, __m128i *lo, __m128i *hi) {
+    __m128i factor = _mm_set1_epi32((int)m);
+    __m128i even = _mm_mul_epu32(a, factor);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), factor);
+
+    *lo = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                             _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    *hi = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 3, 1)),
+                             _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 3, 1)));
+}
+#endif
+
+/* out[d][lane] holds dimension d of the draw for pixel[lane] and sample[lane], mapped to [0, 1). */
+void random_draw_packet(unsigned int seed, const unsigned int *pixel, const unsigned int *sample, unsigned int bounce,
+                        unsigned int block, float out[4][RANDOM_PACKET]) {
+#ifdef __SSE2__
+    __m128i c0 = _mm_loadu_si128((const __m128i *)pixel);
+    __m128i c1 = _mm_loadu_si128((const __m128i *)sample);
+    __m128i c2 = _mm_set1_epi32((int)bounce);
+    __m128i c3 = _mm_set1_epi32((int)block);
+    __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+    unsigned int k0 = seed, k1 = RANDOM_KEY;
+
+    for (int r = 0; r < RANDOM_ROUNDS; r++) {
+        __m128i lo0, hi0, lo1, hi1;
+
+        random_mul(c0, RANDOM_M0, &lo0, &hi0);
+        random_mul(c2, RANDOM_M1, &lo1, &hi1);
+        c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32((int)k0));
+        c1 = lo1;
+        c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32((int)k1));
+        c3 = lo0;
+        k0 += RANDOM_W0;
+        k1 += RANDOM_W1;
+    }
+    _mm_storeu_ps(out[0], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c0, 8)), scale));
+    _mm_storeu_ps(out[1], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c1, 8)), scale));
+    _mm_storeu_ps(out[2], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c2, 8)), scale));
+    _mm_storeu_ps(out[3], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(c3, 8)), scale));
+#else
+    for (int lane = 0; lane < RANDOM_PACKET; lane++) {
+        random_block_t draw = random_draw(seed, pixel[lane], sample[lane], bounce, block);
+        for (int d = 0; d < 4; d++) {
+            out[d][lane] = random_unit(draw.v[d]);
+        }
+    }
+#endif
+}
+
+#endif
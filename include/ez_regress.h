@@ -0,0 +1,114 @@
+#ifndef EZ_REGRESS_H
+#define EZ_REGRESS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <raylib.h>
+
+/*
+ * Golden image comparison. A manifest lists one reference render per line:
+ *
+ *   # scene          golden            max-rmse  min-ssim  budget-seconds
+ *   scenes/book.txt  golden/book.png   0.002     0.99      1.5
+ *   -                golden/default.png 0        1         0
+ *
+ * "-" selects the built in scene and relative paths are taken from the
+ * manifest's directory. RMSE is taken over 8 bit RGB scaled to [0, 1]; SSIM
+ * is the mean over 8x8 luminance blocks, which tracks visible structure
+ * changes better than RMSE. A budget of 0 disables the time check.
+ */
+#define REGRESS_PATH_LENGTH 1024
+#define REGRESS_BLOCK 8
+
+typedef struct {
+    char scene[REGRESS_PATH_LENGTH];
+    char golden[REGRESS_PATH_LENGTH];
+    float maxRmse;
+    float minSsim;
+    double budget;
+} regress_entry_t;
+
+void regress_resolve(char *out, const char *manifest, const char *path) {
+    const char *slash = strrchr(manifest, '/');
+
+    if (path[0] == '/' || strcmp(path, "-") == 0 || slash == NULL) {
+        snprintf(out, REGRESS_PATH_LENGTH, "%s", path);
+    } else {
+        snprintf(out, REGRESS_PATH_LENGTH, "%.*s/%s", (int)(slash - manifest), manifest, path);
+    }
+}
+
+/* Returns 1 for an entry, 0 for a blank or comment line and -1 for a malformed one. */
+int regress_parse_line(const char *line, const char *manifest, regress_entry_t *entry) {
+    char scene[REGRESS_PATH_LENGTH];
+    char golden[REGRESS_PATH_LENGTH];
+
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '#' || *line == '\n' || *line == '\r' || *line == '\0') return 0;
+
+    if (sscanf(line, "%1023s %1023s %f %f %lf", scene, golden, &entry->maxRmse, &entry->minSsim, &entry->budget) != 5) {
+        return -1;
+    }
+    regress_resolve(entry->scene, manifest, scene);
+    regress_resolve(entry->golden, manifest, golden);
+    return 1;
+}
+
+float regress_luma(Color c) {
+    return (0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b) / 255.0f;
+}
+
+double regress_rmse(const Color *a, const Color *b, size_t count) {
+    double sum = 0;
+
+    for (size_t p = 0; p < count; p++) {
+        double dr = (a[p].r - b[p].r) / 255.0;
+        double dg = (a[p].g - b[p].g) / 255.0;
+        double db = (a[p].b - b[p].b) / 255.0;
+        sum += dr * dr + dg * dg + db * db;
+    }
+    return count > 0 ? sqrt(sum / (3.0 * count)) : 0;
+}
+
+double regress_ssim(const Color *a, const Color *b, int width, int height) {
+    const double c1 = 0.01 * 0.01;
+    const double c2 = 0.03 * 0.03;
+    double total = 0;
+    int blocks = 0;
+
+    for (int by = 0; by < height; by += REGRESS_BLOCK) {
+        for (int bx = 0; bx < width; bx += REGRESS_BLOCK) {
+            double meanA = 0, meanB = 0, varA = 0, varB = 0, cov = 0;
+            int n = 0;
+
+            for (int y = by; y < by + REGRESS_BLOCK && y < height; y++) {
+                for (int x = bx; x < bx + REGRESS_BLOCK && x < width; x++) {
+                    meanA += regress_luma(a[(size_t)y * width + x]);
+                    meanB += regress_luma(b[(size_t)y * width + x]);
+                    n++;
+                }
+            }
+            meanA /= n;
+            meanB /= n;
+            for (int y = by; y < by + REGRESS_BLOCK && y < height; y++) {
+                for (int x = bx; x < bx + REGRESS_BLOCK && x < width; x++) {
+                    double da = regress_luma(a[(size_t)y * width + x]) - meanA;
+                    double db = regress_luma(b[(size_t)y * width + x]) - meanB;
+                    varA += da * da;
+                    varB += db * db;
+                    cov += da * db;
+                }
+            }
+            varA /= n;
+            varB /= n;
+            cov /= n;
+            total += ((2 * meanA * meanB + c1) * (2 * cov + c2)) /
+                     ((meanA * meanA + meanB * meanB + c1) * (varA + varB + c2));
+            blocks++;
+        }
+    }
+    return blocks > 0 ? total / blocks : 1;
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef EZ_SAMPLER_H
+#define EZ_SAMPLER_H
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ez_random.h>
+
+/*
+ * Sample generators for the integrand's dimensions. Dimensions are handed
+ * out in pairs starting at an even dimension; the camera jitter uses the
+ * pair at SAMPLER_CAMERA.
+ *
+ *   SAMPLER_RANDOM      Philox draws (see ez_random.h)
+ *   SAMPLER_SOBOL       the first two Sobol dimensions with hash based Owen
+ *                       scrambling; each pixel and pair gets its own index
+ *                       shuffle and scramble seeds (Burley 2020), so pairs
+ *                       stay decorrelated while each one keeps (0, 2)
+ *                       sequence stratification over any power of two run
+ *   SAMPLER_BLUE_NOISE  the same two Sobol dimensions rotated per pixel by
+ *                       a blue noise tile, which moves the remaining error
+ *                       to high frequencies where it is hardest to see
+ *
+ * sampler_init builds the direction numbers and, for blue noise, a
+ * SAMPLER_TILE x SAMPLER_TILE void-and-cluster tile; call it once before
+ * rendering.
+ */
+#define SAMPLER_BITS 32
+#define SAMPLER_TILE 64
+#define SAMPLER_SIGMA 1.5f
+#define SAMPLER_SEED 0x5a3c9e17U
+#define SAMPLER_CAMERA 0
+
+typedef enum {
+    SAMPLER_RANDOM,
+    SAMPLER_SOBOL,
+    SAMPLER_BLUE_NOISE
+} sampler_type;
+
+unsigned int samplerDirections[2][SAMPLER_BITS];
+float samplerBlueNoise[SAMPLER_TILE * SAMPLER_TILE];
+
+unsigned int sampler_reverse(unsigned int x) {
+    x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+    x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fU) | ((x & 0x0f0f0f0fU) << 4);
+    x = ((x >> 8) & 0x00ff00ffU) | ((x & 0x00ff00ffU) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+/* Hash based nested uniform scramble: flipping a bit depends only on the bits above it. */
+unsigned int sampler_owen(unsigned int x, unsigned int seed) {
+    x = sampler_reverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cU;
+    x ^= x * 0xb82f1e52U;
+    x ^= x * 0xc7afe638U;
+    x ^= x * 0x8d22f6e6U;
+    return sampler_reverse(x);
+}
+
+unsigned int sampler_sobol(unsigned int index, int dimension) {
+    unsigned int x = 0;
+
+    for (int bit = 0; index != 0; bit++, index >>= 1) {
+        if (index & 1) x ^= samplerDirections[dimension][bit];
+    }
+    return x;
+}
+
+float sampler_wrap(float x) {
+    return x >= 1.0f ? x - 1.0f : x;
+}
+
+/* Toroidal Gaussian energy every set point adds to the tile, indexed by offset. */
+void sampler_kernel(float *kernel) {
+    for (int dy = 0; dy < SAMPLER_TILE; dy++) {
+        for (int dx = 0; dx < SAMPLER_TILE; dx++) {
+            int wx = dx < SAMPLER_TILE / 2 ? dx : SAMPLER_TILE - dx;
+            int wy = dy < SAMPLER_TILE / 2 ? dy : SAMPLER_TILE - dy;
+            kernel[dy * SAMPLER_TILE + dx] = expf(-(wx * wx + wy * wy) / (2 * SAMPLER_SIGMA * SAMPLER_SIGMA));
+        }
+    }
+}
+
+void sampler_splat(float *energy, const float *kernel, int p, float sign) {
+    int px = p % SAMPLER_TILE;
+    int py = p / SAMPLER_TILE;
+
+    for (int y = 0; y < SAMPLER_TILE; y++) {
+        const float *row = kernel + ((y - py + SAMPLER_TILE) % SAMPLER_TILE) * SAMPLER_TILE;
+        for (int x = 0; x < SAMPLER_TILE; x++) {
+            energy[y * SAMPLER_TILE + x] += sign * row[(x - px + SAMPLER_TILE) % SAMPLER_TILE];
+        }
+    }
+}
+
+/* The set point in the densest cluster (want 1) or the empty one in the largest void (want 0). */
+int sampler_extreme(const float *energy, const unsigned char *set, int want) {
+    int best = -1;
+
+    for (int p = 0; p < SAMPLER_TILE * SAMPLER_TILE; p++) {
+        if (set[p] != want) continue;
+        if (best < 0 || (want ? energy[p] > energy[best] : energy[p] < energy[best])) best = p;
+    }
+    return best;
+}
+
+/*
+ * Void-and-cluster (Ulichney 1993): relax a sparse random pattern until its
+ * tightest cluster and largest void coincide, then rank points by removing
+ * clusters downwards and filling voids upwards.
+ */
+int sampler_blue_noise(float *tile) {
+    const int count = SAMPLER_TILE * SAMPLER_TILE;
+    float *kernel = malloc(sizeof(float) * count);
+    float *energy = calloc(count, sizeof(float));
+    float *prototype = malloc(sizeof(float) * count);
+    unsigned char *set = calloc(count, 1);
+    unsigned char *initial = malloc(count);
+    int ones = 0;
+
+    if (kernel == NULL || energy == NULL || prototype == NULL || set == NULL || initial == NULL) {
+        free(kernel); free(energy); free(prototype); free(set); free(initial);
+        return -1;
+    }
+    sampler_kernel(kernel);
+
+    for (int p = 0; p < count; p++) {
+        if (random_unit(random_draw(SAMPLER_SEED, (unsigned int)p, 0, 0, 0).v[0]) < 0.1f) {
+            set[p] = 1;
+            ones++;
+            sampler_splat(energy, kernel, p, 1);
+        }
+    }
+    for (;;) {
+        int cluster = sampler_extreme(energy, set, 1);
+        set[cluster] = 0;
+        sampler_splat(energy, kernel, cluster, -1);
+        int hole = sampler_extreme(energy, set, 0);
+        set[hole] = 1;
+        sampler_splat(energy, kernel, hole, 1);
+        if (hole == cluster) break;
+    }
+
+    memcpy(initial, set, count);
+    memcpy(prototype, energy, sizeof(float) * count);
+    for (int rank = ones - 1; rank >= 0; rank--) {
+        int cluster = sampler_extreme(energy, set, 1);
+        set[cluster] = 0;
+        sampler_splat(energy, kernel, cluster, -1);
+        tile[cluster] = (float)rank;
+    }
+
+    memcpy(set, initial, count);
+    memcpy(energy, prototype, sizeof(float) * count);
+    for (int rank = ones; rank < count; rank++) {
+        int hole = sampler_extreme(energy, set, 0);
+        set[hole] = 1;
+        sampler_splat(energy, kernel, hole, 1);
+        tile[hole] = (float)rank;
+    }
+
+    for (int p = 0; p < count; p++) {
+        tile[p] = (tile[p] + 0.5f) / count;
+    }
+    free(kernel); free(energy); free(prototype); free(set); free(initial);
+    return 0;
+}
+
+int sampler_init(sampler_type type) {
+    /* Dimension 0 is van der Corput; dimension 1 has the primitive polynomial x + 1 and m = 1. */
+    for (int bit = 0; bit < SAMPLER_BITS; bit++) {
+        samplerDirections[0][bit] = 1U << (SAMPLER_BITS - 1 - bit);
+        samplerDirections[1][bit] = bit == 0 ? 1U << (SAMPLER_BITS - 1)
+                                             : samplerDirections[1][bit - 1] ^ (samplerDirections[1][bit - 1] >> 1);
+    }
+    return type == SAMPLER_BLUE_NOISE ? sampler_blue_noise(samplerBlueNoise) : 0;
+}
+
+/* The pair of dimensions starting at dimension for one pixel sample, each in [0, 1). */
+void sampler_2d(sampler_type type, unsigned int pixel, int x, int y, unsigned int sample, unsigned int dimension,
+                float *out) {
+    if (type == SAMPLER_RANDOM) {
+        random_block_t draw = random_draw(0, pixel, sample, 0, dimension / 4);
+        out[0] = random_unit(draw.v[dimension % 4]);
+        out[1] = random_unit(draw.v[(dimension + 1) % 4]);
+    } else if (type == SAMPLER_SOBOL) {
+        random_block_t seeds = random_draw(SAMPLER_SEED, pixel, dimension, 0, 0);
+        unsigned int index = sampler_owen(sample, seeds.v[0]);
+        out[0] = random_unit(sampler_owen(sampler_sobol(index, 0), seeds.v[1]));
+        out[1] = random_unit(sampler_owen(sampler_sobol(index, 1), seeds.v[2]));
+    } else {
+        int u = x + 13 * (int)dimension;
+        int v = y + 29 * (int)dimension;
+        float shift0 = samplerBlueNoise[(v & (SAMPLER_TILE - 1)) * SAMPLER_TILE + (u & (SAMPLER_TILE - 1))];
+        float shift1 = samplerBlueNoise[((v + SAMPLER_TILE / 2) & (SAMPLER_TILE - 1)) * SAMPLER_TILE +
+                                        ((u + SAMPLER_TILE / 2) & (SAMPLER_TILE - 1))];
+        out[0] = sampler_wrap(random_unit(sampler_sobol(sample, 0)) + shift0);
+        out[1] = sampler_wrap(random_unit(sampler_sobol(sample, 1)) + shift1);
+    }
+}
+
+#endif
@@ -0,0 +1,868 @@
+#ifndef EZ_SCENE_H
+#define EZ_SCENE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ez_tracer.h>
+#include <ez_cluster.h>
+#include <ez_memory.h>
+
+/*
+ * Scenes keep spheres as structure-of-arrays. Binary scene files (.ezs) store
+ * every array as its own 64 byte aligned section, so a mapped file is used in
+ * place: loading is mmap plus pointer fix-ups, with no per-object parsing.
+ *
+ *   header      scene_file_header_t, 64 bytes
+ *   sections    scene_section_t[sectionCount]
+ *   payloads    one per section, each at a 64 byte aligned offset
+ *
+ * Unknown section types are skipped so newer files stay loadable.
+ *
+ * Clustered files leave the sphere sections empty and instead carry a
+ * cluster table plus a page aligned data section with one chunk per cluster
+ * (see ez_cluster.h). Only the part in front of the data section is mapped
+ * up front; chunks are mapped on demand.
+ */
+#define SCENE_MAGIC 0x43535a45U
+#define SCENE_VERSION 2
+#define SCENE_ALIGNMENT 64
+#define SCENE_NAME_LENGTH 32
+#define SCENE_PATH_LENGTH 128
+#define SCENE_MAX_LINE 512
+
+typedef enum {
+    SCENE_SECTION_CENTER_X = 1,
+    SCENE_SECTION_CENTER_Y,
+    SCENE_SECTION_CENTER_Z,
+    SCENE_SECTION_RADIUS,
+    SCENE_SECTION_SPHERE_MATERIAL,
+    SCENE_SECTION_MATERIALS,
+    SCENE_SECTION_LIGHTS,
+    SCENE_SECTION_CLUSTERS,
+    SCENE_SECTION_CLUSTER_DATA,
+    SCENE_SECTION_COUNT
+} scene_section_type;
+
+typedef enum {
+    LIGHT_AMBIENT,
+    LIGHT_POINT,
+    LIGHT_DIRECTIONAL
+} light_type;
+
+typedef struct {
+    Color3 color;
+    float specular;
+    float reflective;
+    int texture;
+    char texturePath[SCENE_PATH_LENGTH];
+} material_t;
+
+typedef struct {
+    int type;
+    float intensity;
+    Vec3 vector;
+} light_t;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int sectionCount;
+    unsigned int reserved;
+    Vec3 camera;
+    Vec3 viewport;
+    Color3 background;
+    unsigned char padding[12];
+} scene_file_header_t;
+
+typedef struct {
+    unsigned int type;
+    unsigned int count;
+    unsigned long long offset;
+    unsigned long long size;
+} scene_section_t;
+
+typedef struct {
+    Vec3 camera;
+    Vec3 viewport;
+    Color3 background;
+    int sphereCount;
+    float *centerX;
+    float *centerY;
+    float *centerZ;
+    float *radius;
+    unsigned int *material;
+    int materialCount;
+    material_t *materials;
+    int lightCount;
+    light_t *lights;
+    char (*materialNames)[SCENE_NAME_LENGTH];
+    int sphereCapacity;
+    int materialCapacity;
+    int lightCapacity;
+    cluster_cache_t *clusters;
+    void *mapping;
+    size_t mappingSize;
+    size_t accounted;
+} scene_t;
+
+size_t scene_alloc_size(size_t count, size_t size) {
+    size_t bytes = (count * size + SCENE_ALIGNMENT - 1) / SCENE_ALIGNMENT * SCENE_ALIGNMENT;
+    return bytes ? bytes : SCENE_ALIGNMENT;
+}
+
+void *scene_alloc(size_t count, size_t size) {
+    size_t bytes = scene_alloc_size(count, size);
+    void *data = aligned_alloc(SCENE_ALIGNMENT, bytes);
+    if (data != NULL) memset(data, 0, bytes);
+    return data;
+}
+
+/* Bytes behind an allocated scene's arrays; mapped scenes account their mapping instead. */
+size_t scene_bytes(scene_t *scene) {
+    return scene_alloc_size(scene->sphereCapacity, sizeof(float)) * 4 +
+           scene_alloc_size(scene->sphereCapacity, sizeof(unsigned int)) +
+           scene_alloc_size(scene->materialCapacity, sizeof(material_t)) +
+           scene_alloc_size(scene->lightCapacity, sizeof(light_t)) +
+           scene_alloc_size(scene->materialCapacity, SCENE_NAME_LENGTH);
+}
+
+void scene_destroy(scene_t *scene) {
+    if (scene->clusters != NULL) {
+        cluster_close(scene->clusters);
+        free(scene->clusters);
+    }
+    memory_add(MEMORY_GEOMETRY, -(long long)scene->accounted);
+    if (scene->mapping != NULL) {
+        munmap(scene->mapping, scene->mappingSize);
+    } else {
+        free(scene->centerX);
+        free(scene->centerY);
+        free(scene->centerZ);
+        free(scene->radius);
+        free(scene->material);
+        free(scene->materials);
+        free(scene->lights);
+        free(scene->materialNames);
+    }
+    memset(scene, 0, sizeof(*scene));
+}
+
+int scene_create(scene_t *scene, int sphereCount, int materialCount, int lightCount) {
+    memset(scene, 0, sizeof(*scene));
+    scene->sphereCount = sphereCount;
+    scene->materialCount = materialCount;
+    scene->lightCount = lightCount;
+    scene->centerX = scene_alloc(sphereCount, sizeof(float));
+    scene->centerY = scene_alloc(sphereCount, sizeof(float));
+    scene->centerZ = scene_alloc(sphereCount, sizeof(float));
+    scene->radius = scene_alloc(sphereCount, sizeof(float));
+    scene->material = scene_alloc(sphereCount, sizeof(unsigned int));
+    scene->materials = scene_alloc(materialCount, sizeof(material_t));
+    scene->lights = scene_alloc(lightCount, sizeof(light_t));
+    scene->materialNames = scene_alloc(materialCount, SCENE_NAME_LENGTH);
+    scene->sphereCapacity = sphereCount;
+    scene->materialCapacity = materialCount;
+    scene->lightCapacity = lightCount;
+    scene->accounted = scene_bytes(scene);
+    memory_add(MEMORY_GEOMETRY, scene->accounted);
+
+    if (scene->centerX == NULL || scene->centerY == NULL || scene->centerZ == NULL || scene->radius == NULL ||
+        scene->material == NULL || scene->materials == NULL || scene->lights == NULL || scene->materialNames == NULL) {
+        scene_destroy(scene);
+        return -1;
+    }
+    return 0;
+}
+
+void scene_set_sphere(scene_t *scene, int index, Vec3 center, float radius, unsigned int material) {
+    scene->centerX[index] = center.x;
+    scene->centerY[index] = center.y;
+    scene->centerZ[index] = center.z;
+    scene->radius[index] = radius;
+    scene->material[index] = material;
+}
+
+unsigned long long scene_align(unsigned long long offset) {
+    return (offset + SCENE_ALIGNMENT - 1) / SCENE_ALIGNMENT * SCENE_ALIGNMENT;
+}
+
+typedef struct {
+    unsigned int code;
+    unsigned int index;
+} scene_morton_t;
+
+unsigned int scene_spread_bits(unsigned int v) {
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+int scene_morton_compare(const void *a, const void *b) {
+    const scene_morton_t *x = (const scene_morton_t *)a;
+    const scene_morton_t *y = (const scene_morton_t *)b;
+    if (x->code != y->code) return x->code < y->code ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* Orders spheres along a Z curve and cuts the order into clusters of at most clusterSize spheres. */
+cluster_t *scene_build_clusters(scene_t *scene, int clusterSize, unsigned long long dataOffset, unsigned int **order,
+                                int *clusterCount, unsigned long long *dataSize) {
+    scene_morton_t *keys = malloc(sizeof(scene_morton_t) * (scene->sphereCount > 0 ? scene->sphereCount : 1));
+    int count = (scene->sphereCount + clusterSize - 1) / clusterSize;
+    cluster_t *clusters = calloc(count > 0 ? count : 1, sizeof(cluster_t));
+    Vec3 lo = {INFINITY, INFINITY, INFINITY};
+    Vec3 hi = {-INFINITY, -INFINITY, -INFINITY};
+    unsigned long long offset = dataOffset;
+    unsigned long long end = dataOffset;
+
+    *order = malloc(sizeof(unsigned int) * (scene->sphereCount > 0 ? scene->sphereCount : 1));
+    if (keys == NULL || clusters == NULL || *order == NULL) {
+        free(keys);
+        free(clusters);
+        free(*order);
+        return NULL;
+    }
+
+    for (int i = 0; i < scene->sphereCount; i++) {
+        lo = (Vec3){fminf(lo.x, scene->centerX[i]), fminf(lo.y, scene->centerY[i]), fminf(lo.z, scene->centerZ[i])};
+        hi = (Vec3){fmaxf(hi.x, scene->centerX[i]), fmaxf(hi.y, scene->centerY[i]), fmaxf(hi.z, scene->centerZ[i])};
+    }
+    for (int i = 0; i < scene->sphereCount; i++) {
+        float p[3] = {scene->centerX[i], scene->centerY[i], scene->centerZ[i]};
+        float l[3] = {lo.x, lo.y, lo.z};
+        float h[3] = {hi.x, hi.y, hi.z};
+        unsigned int q[3];
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = h[axis] - l[axis];
+            q[axis] = extent > 0 ? (unsigned int)((p[axis] - l[axis]) / extent * 1023.0f) : 0;
+        }
+        keys[i] = (scene_morton_t){scene_spread_bits(q[0]) | scene_spread_bits(q[1]) << 1 | scene_spread_bits(q[2]) << 2,
+                                   (unsigned int)i};
+    }
+    qsort(keys, scene->sphereCount, sizeof(scene_morton_t), scene_morton_compare);
+
+    for (int c = 0; c < count; c++) {
+        cluster_t *cluster = &clusters[c];
+        int first = c * clusterSize;
+        int last = first + clusterSize < scene->sphereCount ? first + clusterSize : scene->sphereCount;
+
+        cluster->min = (Vec3){INFINITY, INFINITY, INFINITY};
+        cluster->max = (Vec3){-INFINITY, -INFINITY, -INFINITY};
+        for (int k = first; k < last; k++) {
+            int i = keys[k].index;
+            float r = scene->radius[i];
+            (*order)[k] = (unsigned int)i;
+            cluster->min = (Vec3){fminf(cluster->min.x, scene->centerX[i] - r), fminf(cluster->min.y, scene->centerY[i] - r),
+                                  fminf(cluster->min.z, scene->centerZ[i] - r)};
+            cluster->max = (Vec3){fmaxf(cluster->max.x, scene->centerX[i] + r), fmaxf(cluster->max.y, scene->centerY[i] + r),
+                                  fmaxf(cluster->max.z, scene->centerZ[i] + r)};
+        }
+        cluster->count = (unsigned int)(last - first);
+        cluster->stride = cluster_stride(cluster->count);
+        cluster->offset = offset;
+        cluster->size = (unsigned long long)cluster->stride * 5 * sizeof(float);
+        end = offset + cluster->size;
+        offset = (offset + cluster->size + CLUSTER_FILE_ALIGNMENT - 1) / CLUSTER_FILE_ALIGNMENT * CLUSTER_FILE_ALIGNMENT;
+    }
+
+    free(keys);
+    *clusterCount = count;
+    *dataSize = end - dataOffset;
+    return clusters;
+}
+
+int scene_write_padding(FILE *file, unsigned long long offset) {
+    static const unsigned char zeros[CLUSTER_FILE_ALIGNMENT] = {0};
+    long long pad = (long long)offset - ftello(file);
+
+    while (pad > 0) {
+        size_t chunk = pad < CLUSTER_FILE_ALIGNMENT ? (size_t)pad : CLUSTER_FILE_ALIGNMENT;
+        if (fwrite(zeros, 1, chunk, file) != chunk) return -1;
+        pad -= chunk;
+    }
+    return pad == 0 ? 0 : -1;
+}
+
+int scene_write_cluster(FILE *file, scene_t *scene, cluster_t *cluster, const unsigned int *indices) {
+    float *chunk = calloc((size_t)cluster->stride * 5, sizeof(float));
+    unsigned int *material = (unsigned int *)(chunk + (size_t)cluster->stride * 4);
+    int status;
+
+    if (chunk == NULL) return -1;
+    for (unsigned int k = 0; k < cluster->count; k++) {
+        unsigned int i = indices[k];
+        chunk[k] = scene->centerX[i];
+        chunk[cluster->stride + k] = scene->centerY[i];
+        chunk[2 * cluster->stride + k] = scene->centerZ[i];
+        chunk[3 * cluster->stride + k] = scene->radius[i];
+        material[k] = scene->material[i];
+    }
+    status = scene_write_padding(file, cluster->offset) == 0 &&
+             fwrite(chunk, 1, cluster->size, file) == cluster->size ? 0 : -1;
+    free(chunk);
+    return status;
+}
+
+/* Writes a .ezs file; a positive clusterSize moves the spheres into out-of-core clusters. */
+int scene_write_binary(scene_t *scene, const char *path, int clusterSize) {
+    scene_section_t sections[SCENE_SECTION_COUNT - 1];
+    const void *payloads[SCENE_SECTION_COUNT - 1];
+    int spheres = clusterSize > 0 ? 0 : scene->sphereCount;
+    int count = clusterSize > 0 ? SCENE_SECTION_COUNT - 1 : SCENE_SECTION_CLUSTERS - 1;
+    cluster_t *clusters = NULL;
+    unsigned int *order = NULL;
+    int clusterCount = 0;
+    unsigned long long dataSize = 0;
+    scene_file_header_t header;
+    unsigned long long offset;
+    int status = 0;
+    FILE *file;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = SCENE_MAGIC;
+    header.version = SCENE_VERSION;
+    header.sectionCount = (unsigned int)count;
+    header.camera = scene->camera;
+    header.viewport = scene->viewport;
+    header.background = scene->background;
+
+    payloads[0] = scene->centerX;
+    payloads[1] = scene->centerY;
+    payloads[2] = scene->centerZ;
+    payloads[3] = scene->radius;
+    payloads[4] = scene->material;
+    payloads[5] = scene->materials;
+    payloads[6] = scene->lights;
+
+    offset = scene_align(sizeof(header) + sizeof(scene_section_t) * count);
+    for (int s = 0; s < SCENE_SECTION_CLUSTERS - 1; s++) {
+        unsigned int type = SCENE_SECTION_CENTER_X + s;
+        size_t element = type == SCENE_SECTION_MATERIALS ? sizeof(material_t) :
+                         type == SCENE_SECTION_LIGHTS ? sizeof(light_t) : sizeof(float);
+        unsigned int elements = type == SCENE_SECTION_MATERIALS ? scene->materialCount :
+                                type == SCENE_SECTION_LIGHTS ? scene->lightCount : spheres;
+        sections[s] = (scene_section_t){type, elements, offset, (unsigned long long)element * elements};
+        offset = scene_align(offset + sections[s].size);
+    }
+
+    if (clusterSize > 0) {
+        int tableIndex = SCENE_SECTION_CLUSTERS - 1;
+        unsigned long long tableSize = sizeof(cluster_t) * ((scene->sphereCount + clusterSize - 1) / clusterSize);
+        unsigned long long dataOffset = (offset + tableSize + CLUSTER_FILE_ALIGNMENT - 1) / CLUSTER_FILE_ALIGNMENT *
+                                        CLUSTER_FILE_ALIGNMENT;
+
+        clusters = scene_build_clusters(scene, clusterSize, dataOffset, &order, &clusterCount, &dataSize);
+        if (clusters == NULL) return -1;
+        sections[tableIndex] = (scene_section_t){SCENE_SECTION_CLUSTERS, (unsigned int)clusterCount, offset, tableSize};
+        sections[tableIndex + 1] = (scene_section_t){SCENE_SECTION_CLUSTER_DATA, (unsigned int)clusterCount, dataOffset, dataSize};
+        payloads[tableIndex] = clusters;
+        payloads[tableIndex + 1] = NULL;
+    }
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        free(clusters);
+        free(order);
+        return -1;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(sections, sizeof(scene_section_t), count, file) != (size_t)count) {
+        status = -1;
+    }
+    for (int s = 0; s < count && status == 0; s++) {
+        if (sections[s].type == SCENE_SECTION_CLUSTER_DATA) {
+            for (int c = 0; c < clusterCount && status == 0; c++) {
+                status = scene_write_cluster(file, scene, &clusters[c], order + (size_t)c * clusterSize);
+            }
+        } else if (scene_write_padding(file, sections[s].offset) != 0 ||
+                   (sections[s].size > 0 && fwrite(payloads[s], 1, sections[s].size, file) != sections[s].size)) {
+            status = -1;
+        }
+    }
+    if (fclose(file) != 0) status = -1;
+    free(clusters);
+    free(order);
+    return status;
+}
+
+size_t scene_section_element(unsigned int type) {
+    switch (type) {
+        case SCENE_SECTION_CENTER_X:
+        case SCENE_SECTION_CENTER_Y:
+        case SCENE_SECTION_CENTER_Z:
+        case SCENE_SECTION_RADIUS: return sizeof(float);
+        case SCENE_SECTION_SPHERE_MATERIAL: return sizeof(unsigned int);
+        case SCENE_SECTION_MATERIALS: return sizeof(material_t);
+        case SCENE_SECTION_LIGHTS: return sizeof(light_t);
+        case SCENE_SECTION_CLUSTERS: return sizeof(cluster_t);
+        default: return 0;
+    }
+}
+
+/* The section lies within limit bytes and is big enough for count elements; every sum is checked before it can wrap. */
+int scene_section_fits(const scene_section_t *section, unsigned long long limit) {
+    return section->offset <= limit && section->size <= limit - section->offset && section->count <= INT_MAX &&
+           section->size >= (unsigned long long)section->count * scene_section_element(section->type);
+}
+
+int scene_load_binary(scene_t *scene, const char *path, size_t clusterBudget) {
+    struct stat info;
+    scene_file_header_t header;
+    scene_section_t *sections;
+    scene_section_t data = {0};
+    unsigned int counts[SCENE_SECTION_COUNT] = {0};
+    cluster_t *clusters = NULL;
+    int clusterCount = 0;
+    unsigned char *base;
+    size_t resident;
+    int fd = open(path, O_RDONLY);
+
+    memset(scene, 0, sizeof(*scene));
+    if (fd < 0) return -1;
+    if (fstat(fd, &info) != 0 || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        header.magic != SCENE_MAGIC || header.version != SCENE_VERSION ||
+        sizeof(header) + (size_t)header.sectionCount * sizeof(scene_section_t) > (size_t)info.st_size) {
+        close(fd);
+        return -1;
+    }
+
+    sections = malloc(sizeof(scene_section_t) * (header.sectionCount > 0 ? header.sectionCount : 1));
+    if (sections == NULL ||
+        pread(fd, sections, sizeof(scene_section_t) * header.sectionCount, sizeof(header)) !=
+            (ssize_t)(sizeof(scene_section_t) * header.sectionCount)) {
+        free(sections);
+        close(fd);
+        return -1;
+    }
+
+    resident = (size_t)info.st_size;
+    for (unsigned int s = 0; s < header.sectionCount; s++) {
+        if (sections[s].type == SCENE_SECTION_CLUSTER_DATA) {
+            data = sections[s];
+            resident = (size_t)data.offset;
+        }
+    }
+    if (data.type != 0 && !scene_section_fits(&data, (unsigned long long)info.st_size)) resident = 0;
+
+    base = resident > 0 ? mmap(NULL, resident, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (base == MAP_FAILED) {
+        free(sections);
+        close(fd);
+        return -1;
+    }
+
+    scene->mapping = base;
+    scene->mappingSize = resident;
+    scene->accounted = resident;
+    memory_add(MEMORY_GEOMETRY, resident);
+    scene->camera = header.camera;
+    scene->viewport = header.viewport;
+    scene->background = header.background;
+
+    for (unsigned int s = 0; s < header.sectionCount; s++) {
+        scene_section_t *section = &sections[s];
+        void *payload = base + section->offset;
+
+        if (section->type == SCENE_SECTION_CLUSTER_DATA) continue;
+        if (section->offset % SCENE_ALIGNMENT != 0 || !scene_section_fits(section, scene->mappingSize)) {
+            free(sections);
+            close(fd);
+            scene_destroy(scene);
+            return -1;
+        }
+        if (section->type < SCENE_SECTION_COUNT) counts[section->type] = section->count;
+        switch (section->type) {
+            case SCENE_SECTION_CENTER_X: scene->centerX = payload; scene->sphereCount = section->count; break;
+            case SCENE_SECTION_CENTER_Y: scene->centerY = payload; break;
+            case SCENE_SECTION_CENTER_Z: scene->centerZ = payload; break;
+            case SCENE_SECTION_RADIUS: scene->radius = payload; break;
+            case SCENE_SECTION_SPHERE_MATERIAL: scene->material = payload; break;
+            case SCENE_SECTION_MATERIALS: scene->materials = payload; scene->materialCount = section->count; break;
+            case SCENE_SECTION_LIGHTS: scene->lights = payload; scene->lightCount = section->count; break;
+            case SCENE_SECTION_CLUSTERS: clusters = payload; clusterCount = section->count; break;
+            default: break;
+        }
+    }
+    free(sections);
+
+    int valid = scene->centerX != NULL && scene->centerY != NULL && scene->centerZ != NULL && scene->radius != NULL &&
+                scene->material != NULL && scene->materials != NULL && scene->materialCount > 0 &&
+                (clusters == NULL) == (data.type == 0);
+    for (int type = SCENE_SECTION_CENTER_Y; type <= SCENE_SECTION_SPHERE_MATERIAL && valid; type++) {
+        valid = counts[type] == counts[SCENE_SECTION_CENTER_X];
+    }
+    for (int i = 0; i < scene->sphereCount && valid; i++) {
+        valid = scene->material[i] < (unsigned int)scene->materialCount;
+    }
+    for (int c = 0; c < clusterCount && valid; c++) {
+        unsigned long long start = clusters[c].offset - data.offset;
+        valid = clusters[c].offset >= data.offset && start <= data.size && clusters[c].size <= data.size - start;
+    }
+    for (int m = 0; m < scene->materialCount && valid; m++) {
+        scene->materials[m].texture = -1;
+        scene->materials[m].texturePath[SCENE_PATH_LENGTH - 1] = '\0';
+    }
+
+    if (valid && clusters != NULL) {
+        scene->clusters = malloc(sizeof(cluster_cache_t));
+        valid = scene->clusters != NULL &&
+                cluster_open(scene->clusters, fd, clusters, clusterCount, scene->materialCount, clusterBudget) == 0;
+        if (!valid) {
+            free(scene->clusters);
+            scene->clusters = NULL;
+        }
+    }
+    if (scene->clusters == NULL) close(fd);
+    if (!valid) {
+        scene_destroy(scene);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Text scenes, one statement per line, '#' starts a comment:
+ *   camera x y z
+ *   viewport width height distance
+ *   background r g b
+ *   material name r g b specular reflective [texture]
+ *   sphere x y z radius material
+ *   light ambient intensity
+ *   light point intensity x y z
+ *   light directional intensity x y z
+ * Materials must be declared before the spheres that use them.
+ *
+ * The file is mapped and parsed in one pass straight into the scene arrays,
+ * without allocating. When the scene is too small the statements are still
+ * counted, so the caller can grow it once and parse again.
+ */
+typedef struct {
+    const char *cursor;
+    const char *end;
+    int line;
+} scene_reader_t;
+
+void scene_skip_blanks(scene_reader_t *reader) {
+    while (reader->cursor < reader->end && (*reader->cursor == ' ' || *reader->cursor == '\t' || *reader->cursor == '\r')) {
+        reader->cursor++;
+    }
+}
+
+int scene_word(scene_reader_t *reader, const char **word) {
+    const char *start;
+
+    scene_skip_blanks(reader);
+    start = reader->cursor;
+    while (reader->cursor < reader->end && *reader->cursor > ' ' && *reader->cursor != '#') {
+        reader->cursor++;
+    }
+    *word = start;
+    return (int)(reader->cursor - start);
+}
+
+int scene_word_is(const char *word, int length, const char *keyword) {
+    return (int)strlen(keyword) == length && memcmp(word, keyword, length) == 0;
+}
+
+int scene_float(scene_reader_t *reader, float *value) {
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+    const char *p;
+    const char *end = reader->end;
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    int negative = 0;
+    double result;
+
+    scene_skip_blanks(reader);
+    p = reader->cursor;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    for (; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+        if (mantissa < 100000000000000000ULL) mantissa = mantissa * 10 + (*p - '0');
+        else exponent++;
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+            if (mantissa < 100000000000000000ULL) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+    if (digits == 0) return -1;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int sign = 1;
+        int power = 0;
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) sign = *p++ == '-' ? -1 : 1;
+        if (p >= end || *p < '0' || *p > '9') return -1;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (power < 1000) power = power * 10 + (*p - '0');
+        }
+        exponent += sign * power;
+    }
+    if (p < end && *p > ' ' && *p != '#') return -1;
+
+    result = (double)mantissa;
+    while (exponent > 18) { result *= 1e18; exponent -= 18; }
+    while (exponent < -18) { result /= 1e18; exponent += 18; }
+    result = exponent >= 0 ? result * powers[exponent] : result / powers[-exponent];
+    *value = (float)(negative ? -result : result);
+    reader->cursor = p;
+    return 0;
+}
+
+int scene_floats(scene_reader_t *reader, float *values, int count) {
+    for (int i = 0; i < count; i++) {
+        if (scene_float(reader, &values[i]) != 0) return -1;
+    }
+    return 0;
+}
+
+int scene_end_of_line(scene_reader_t *reader) {
+    scene_skip_blanks(reader);
+    if (reader->cursor < reader->end && *reader->cursor == '#') {
+        while (reader->cursor < reader->end && *reader->cursor != '\n') reader->cursor++;
+    }
+    if (reader->cursor < reader->end && *reader->cursor != '\n') return -1;
+    if (reader->cursor < reader->end) reader->cursor++;
+    reader->line++;
+    return 0;
+}
+
+int scene_find_material(scene_t *scene, int count, const char *name, int length) {
+    if (length >= SCENE_NAME_LENGTH) return -1;
+    for (int m = 0; m < count; m++) {
+        if (memcmp(scene->materialNames[m], name, length) == 0 && scene->materialNames[m][length] == '\0') return m;
+    }
+    return -1;
+}
+
+/* Returns 0 when parsed, 1 when the scene needs more capacity (counts hold the totals), -1 on a syntax error. */
+int scene_parse(scene_t *scene, const char *text, size_t length, int *errorLine) {
+    scene_reader_t reader = {text, text + length, 1};
+    int spheres = 0, materials = 0, lights = 0;
+
+    scene->camera = (Vec3){0, 0, 0};
+    scene->viewport = (Vec3){1, 1, 1};
+    scene->background = (Color3){1, 1, 1};
+
+    while (reader.cursor < reader.end) {
+        const char *word;
+        const char *name;
+        int wordLength = scene_word(&reader, &word);
+        int nameLength;
+        float v[6];
+        int ok = 1;
+
+        if (wordLength == 0) {
+            /* blank or comment line */
+        } else if (scene_word_is(word, wordLength, "camera")) {
+            ok = scene_floats(&reader, v, 3) == 0;
+            scene->camera = (Vec3){v[0], v[1], v[2]};
+        } else if (scene_word_is(word, wordLength, "viewport")) {
+            ok = scene_floats(&reader, v, 3) == 0;
+            scene->viewport = (Vec3){v[0], v[1], v[2]};
+        } else if (scene_word_is(word, wordLength, "background")) {
+            ok = scene_floats(&reader, v, 3) == 0;
+            scene->background = (Color3){v[0], v[1], v[2]};
+        } else if (scene_word_is(word, wordLength, "material")) {
+            const char *path;
+            int pathLength;
+            nameLength = scene_word(&reader, &name);
+            ok = nameLength > 0 && nameLength < SCENE_NAME_LENGTH && scene_floats(&reader, v, 5) == 0;
+            pathLength = ok ? scene_word(&reader, &path) : 0;
+            ok = ok && pathLength < SCENE_PATH_LENGTH;
+            if (ok && materials < scene->materialCapacity) {
+                material_t *material = &scene->materials[materials];
+                memcpy(scene->materialNames[materials], name, nameLength);
+                scene->materialNames[materials][nameLength] = '\0';
+                *material = (material_t){.color = {v[0], v[1], v[2]}, .specular = v[3], .reflective = v[4], .texture = -1};
+                memcpy(material->texturePath, path, pathLength);
+            }
+            materials++;
+        } else if (scene_word_is(word, wordLength, "sphere")) {
+            ok = scene_floats(&reader, v, 4) == 0 && (nameLength = scene_word(&reader, &name)) > 0;
+            if (ok && spheres < scene->sphereCapacity && materials <= scene->materialCapacity) {
+                int m = scene_find_material(scene, materials, name, nameLength);
+                ok = m >= 0;
+                if (ok) scene_set_sphere(scene, spheres, (Vec3){v[0], v[1], v[2]}, v[3], (unsigned int)m);
+            }
+            spheres++;
+        } else if (scene_word_is(word, wordLength, "light")) {
+            light_t light = {LIGHT_AMBIENT, 0, (Vec3){0, 0, 0}};
+            nameLength = scene_word(&reader, &name);
+            if (scene_word_is(name, nameLength, "ambient")) {
+                ok = scene_float(&reader, &light.intensity) == 0;
+            } else if (scene_word_is(name, nameLength, "point") || scene_word_is(name, nameLength, "directional")) {
+                light.type = scene_word_is(name, nameLength, "point") ? LIGHT_POINT : LIGHT_DIRECTIONAL;
+                ok = scene_floats(&reader, v, 4) == 0;
+                light.intensity = v[0];
+                light.vector = (Vec3){v[1], v[2], v[3]};
+            } else {
+                ok = 0;
+            }
+            if (ok && lights < scene->lightCapacity) scene->lights[lights] = light;
+            lights++;
+        } else {
+            ok = 0;
+        }
+
+        if (!ok || scene_end_of_line(&reader) != 0) {
+            *errorLine = reader.line;
+            return -1;
+        }
+    }
+
+    scene->sphereCount = spheres;
+    scene->materialCount = materials;
+    scene->lightCount = lights;
+    if (spheres > scene->sphereCapacity || materials > scene->materialCapacity || lights > scene->lightCapacity) {
+        return 1;
+    }
+    return materials > 0 ? 0 : -1;
+}
+
+/* Parses a text scene into an unmapped scene, growing it only when the file outgrew it. */
+int scene_parse_file(scene_t *scene, const char *path) {
+    struct stat info;
+    const char *text;
+    int errorLine = 0;
+    int status;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) return -1;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    text = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) return -1;
+
+    status = scene_parse(scene, text, (size_t)info.st_size, &errorLine);
+    if (status == 1) {
+        scene_t grown;
+        if (scene_create(&grown, scene->sphereCount, scene->materialCount, scene->lightCount) == 0) {
+            scene_destroy(scene);
+            *scene = grown;
+            status = scene_parse(scene, text, (size_t)info.st_size, &errorLine);
+        } else {
+            status = -1;
+        }
+    }
+    if (status != 0 && errorLine > 0) {
+        fprintf(stderr, "%s:%d: cannot parse statement\n", path, errorLine);
+    }
+
+    munmap((void *)text, (size_t)info.st_size);
+    return status == 0 ? 0 : -1;
+}
+
+int scene_load_text(scene_t *scene, const char *path) {
+    memset(scene, 0, sizeof(*scene));
+    if (scene_parse_file(scene, path) != 0) {
+        scene_destroy(scene);
+        return -1;
+    }
+    return 0;
+}
+
+int scene_load(scene_t *scene, const char *path, size_t clusterBudget) {
+    const char *extension = strrchr(path, '.');
+    if (extension != NULL && strcasecmp(extension, ".ezs") == 0) {
+        return scene_load_binary(scene, path, clusterBudget);
+    }
+    return scene_load_text(scene, path);
+}
+
+/*
+ * Brings scene up to date with staging and returns how many entries changed.
+ * When the counts fit, only the differing spheres, materials and lights are
+ * copied; otherwise the two scenes are swapped and staging keeps the old one.
+ */
+int scene_material_equal(material_t *a, material_t *b) {
+    return memcmp(&a->color, &b->color, sizeof(Color3)) == 0 && a->specular == b->specular &&
+           a->reflective == b->reflective && strcmp(a->texturePath, b->texturePath) == 0;
+}
+
+int scene_update(scene_t *scene, scene_t *staging) {
+    int changed = 0;
+
+    if (scene->mapping != NULL || staging->clusters != NULL || staging->sphereCount > scene->sphereCapacity ||
+        staging->materialCount > scene->materialCapacity || staging->lightCount > scene->lightCapacity) {
+        scene_t previous = *scene;
+        *scene = *staging;
+        *staging = previous;
+        return scene->sphereCount + scene->materialCount + scene->lightCount + 1;
+    }
+
+    if (memcmp(&scene->camera, &staging->camera, sizeof(Vec3)) != 0 ||
+        memcmp(&scene->viewport, &staging->viewport, sizeof(Vec3)) != 0 ||
+        memcmp(&scene->background, &staging->background, sizeof(Color3)) != 0) {
+        scene->camera = staging->camera;
+        scene->viewport = staging->viewport;
+        scene->background = staging->background;
+        changed++;
+    }
+
+    for (int i = 0; i < staging->sphereCount; i++) {
+        if (i >= scene->sphereCount || scene->centerX[i] != staging->centerX[i] || scene->centerY[i] != staging->centerY[i] ||
+            scene->centerZ[i] != staging->centerZ[i] || scene->radius[i] != staging->radius[i] ||
+            scene->material[i] != staging->material[i]) {
+            scene->centerX[i] = staging->centerX[i];
+            scene->centerY[i] = staging->centerY[i];
+            scene->centerZ[i] = staging->centerZ[i];
+            scene->radius[i] = staging->radius[i];
+            scene->material[i] = staging->material[i];
+            changed++;
+        }
+    }
+    for (int m = 0; m < staging->materialCount; m++) {
+        if (m >= scene->materialCount || !scene_material_equal(&scene->materials[m], &staging->materials[m])) {
+            scene->materials[m] = staging->materials[m];
+            changed++;
+        }
+        memcpy(scene->materialNames[m], staging->materialNames[m], SCENE_NAME_LENGTH);
+    }
+    for (int l = 0; l < staging->lightCount; l++) {
+        if (l >= scene->lightCount || memcmp(&scene->lights[l], &staging->lights[l], sizeof(light_t)) != 0) {
+            scene->lights[l] = staging->lights[l];
+            changed++;
+        }
+    }
+
+    changed += scene->sphereCount > staging->sphereCount ? scene->sphereCount - staging->sphereCount : 0;
+    changed += scene->materialCount > staging->materialCount ? scene->materialCount - staging->materialCount : 0;
+    changed += scene->lightCount > staging->lightCount ? scene->lightCount - staging->lightCount : 0;
+    scene->sphereCount = staging->sphereCount;
+    scene->materialCount = staging->materialCount;
+    scene->lightCount = staging->lightCount;
+    return changed;
+}
+
+/* Re-reads path into staging and applies it; returns the change count or -1, leaving scene untouched. */
+int scene_reload(scene_t *scene, scene_t *staging, const char *path, size_t clusterBudget) {
+    const char *extension = strrchr(path, '.');
+
+    if (staging->mapping != NULL) scene_destroy(staging);
+    if (extension != NULL && strcasecmp(extension, ".ezs") == 0) {
+        scene_destroy(staging);
+        if (scene_load_binary(staging, path, clusterBudget) != 0) return -1;
+    } else if (scene_parse_file(staging, path) != 0) {
+        return -1;
+    }
+    return scene_update(scene, staging);
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef EZ_STATS_H
+#define EZ_STATS_H
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Ray and traversal counters. Every tile owns one cache line sized
+ * ray_stats_t and a tile is only ever rendered by one thread at a time, so
+ * counting needs neither atomics nor locks. The per-tile counters are summed
+ * in tile order once a pass is done, which keeps the floating point totals
+ * independent of thread count and scheduling.
+ *
+ * tests counts ray-sphere tests and nodes counts acceleration structure nodes
+ * visited (cluster bounds today, see ez_accel.h). depthSum adds up the hit distance of every
+ * camera and reflection ray that hit something, and busy the seconds the
+ * thread spent inside tiles.
+ */
+typedef enum {
+    RAY_PRIMARY,
+    RAY_SHADOW,
+    RAY_REFLECTION,
+    RAY_TYPE_COUNT
+} ray_type;
+
+typedef struct {
+    unsigned long long rays[RAY_TYPE_COUNT];
+    unsigned long long tests;
+    unsigned long long nodes;
+    unsigned long long hits;
+    double depthSum;
+    double busy;
+} __attribute__((aligned(64))) ray_stats_t;
+
+void stats_merge(ray_stats_t *into, const ray_stats_t *from, int count) {
+    for (int i = 0; i < count; i++) {
+        for (int type = 0; type < RAY_TYPE_COUNT; type++) {
+            into->rays[type] += from[i].rays[type];
+        }
+        into->tests += from[i].tests;
+        into->nodes += from[i].nodes;
+        into->hits += from[i].hits;
+        into->depthSum += from[i].depthSum;
+        into->busy += from[i].busy;
+    }
+}
+
+unsigned long long stats_rays(const ray_stats_t *stats) {
+    unsigned long long total = 0;
+    for (int type = 0; type < RAY_TYPE_COUNT; type++) {
+        total += stats->rays[type];
+    }
+    return total;
+}
+
+void stats_reset(ray_stats_t *stats, int count) {
+    memset(stats, 0, sizeof(ray_stats_t) * count);
+}
+
+/* Cache line aligned and zeroed; release with free. */
+ray_stats_t *stats_create(int count) {
+    ray_stats_t *stats = aligned_alloc(64, sizeof(ray_stats_t) * (count > 0 ? count : 1));
+    if (stats != NULL) stats_reset(stats, count);
+    return stats;
+}
+
+#endif
@@ -0,0 +1,277 @@
+#ifndef EZ_STREAM_H
+#define EZ_STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <ez_deflate.h>
+#include <ez_memory.h>
+#include <ez_queue.h>
+
+/*
+ * Writes an image top to bottom in bands of rows so the whole frame never
+ * has to exist in memory. PNG bands are filtered and deflated as they
+ * arrive; PFM rows are placed at their bottom-up file offset directly.
+ */
+typedef enum {
+    STREAM_PPM,
+    STREAM_PFM,
+    STREAM_PNG
+} stream_format;
+
+typedef struct {
+    FILE *file;
+    stream_format format;
+    int width;
+    int height;
+    int rowsWritten;
+    off_t dataOffset;
+    unsigned char *scratch;
+    size_t scratchSize;
+    deflate_t deflate;
+    unsigned int adler;
+} stream_writer_t;
+
+typedef struct {
+    float *rgb;
+    int rows;
+} stream_band_t;
+
+typedef struct {
+    stream_writer_t writer;
+    queue_t queue;
+    pthread_t thread;
+    int error;
+} stream_async_t;
+
+unsigned char to_byte(float v) {
+    if (v <= 0) return 0;
+    if (v >= 1) return 255;
+    return (unsigned char)(v * 255 + 0.5f);
+}
+
+stream_format stream_format_from_path(const char *path) {
+    const char *extension = strrchr(path, '.');
+    if (extension != NULL && strcasecmp(extension, ".pfm") == 0) return STREAM_PFM;
+    if (extension != NULL && strcasecmp(extension, ".ppm") == 0) return STREAM_PPM;
+    return STREAM_PNG;
+}
+
+void stream_put_u32(unsigned char *p, unsigned int v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+int stream_png_chunk(FILE *file, const char *type, const unsigned char *data, size_t length) {
+    unsigned char header[8];
+    unsigned char footer[4];
+    unsigned int crc;
+
+    stream_put_u32(header, (unsigned int)length);
+    memcpy(header + 4, type, 4);
+    crc = crc32_update(0, header + 4, 4);
+    crc = crc32_update(crc, data, length);
+    stream_put_u32(footer, crc);
+
+    if (fwrite(header, 1, 8, file) != 8) return -1;
+    if (length > 0 && fwrite(data, 1, length, file) != length) return -1;
+    return fwrite(footer, 1, 4, file) == 4 ? 0 : -1;
+}
+
+unsigned char *stream_scratch(stream_writer_t *writer, size_t size) {
+    if (size > writer->scratchSize) {
+        unsigned char *grown = realloc(writer->scratch, size);
+        if (grown == NULL) return NULL;
+        memory_add(MEMORY_OUTPUT, (long long)(size - writer->scratchSize));
+        writer->scratch = grown;
+        writer->scratchSize = size;
+    }
+    return writer->scratch;
+}
+
+int stream_open(stream_writer_t *writer, const char *path, int width, int height) {
+    memset(writer, 0, sizeof(*writer));
+    writer->format = stream_format_from_path(path);
+    writer->width = width;
+    writer->height = height;
+    writer->adler = 1;
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL) return -1;
+
+    if (writer->format == STREAM_PPM) {
+        fprintf(writer->file, "P6\n%d %d\n255\n", width, height);
+    } else if (writer->format == STREAM_PFM) {
+        fprintf(writer->file, "PF\n%d %d\n-1.0\n", width, height);
+        writer->dataOffset = ftello(writer->file);
+    } else {
+        unsigned char ihdr[13] = {0, 0, 0, 0, 0, 0, 0, 0, 8, 2, 0, 0, 0};
+        const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        const unsigned char zlibHeader[2] = {0x78, 0x01};
+
+        stream_put_u32(ihdr, (unsigned int)width);
+        stream_put_u32(ihdr + 4, (unsigned int)height);
+        if (deflate_init(&writer->deflate) != 0 ||
+            fwrite(signature, 1, 8, writer->file) != 8 ||
+            stream_png_chunk(writer->file, "IHDR", ihdr, 13) != 0 ||
+            stream_png_chunk(writer->file, "IDAT", zlibHeader, 2) != 0) {
+            return -1;
+        }
+    }
+    return ferror(writer->file) ? -1 : 0;
+}
+
+int stream_write_rows(stream_writer_t *writer, const float *rgb, int rows) {
+    size_t rowValues = (size_t)writer->width * 3;
+
+    if (writer->rowsWritten + rows > writer->height) return -1;
+
+    if (writer->format == STREAM_PFM) {
+        size_t rowBytes = rowValues * sizeof(float);
+        for (int r = 0; r < rows; r++) {
+            int fileRow = writer->height - 1 - (writer->rowsWritten + r);
+            if (fseeko(writer->file, writer->dataOffset + (off_t)fileRow * rowBytes, SEEK_SET) != 0 ||
+                fwrite(rgb + r * rowValues, sizeof(float), rowValues, writer->file) != rowValues) {
+                return -1;
+            }
+        }
+        writer->rowsWritten += rows;
+        return 0;
+    }
+
+    if (writer->format == STREAM_PPM) {
+        unsigned char *bytes = stream_scratch(writer, rowValues * rows);
+        if (bytes == NULL) return -1;
+        for (size_t i = 0; i < rowValues * rows; i++) bytes[i] = to_byte(rgb[i]);
+        writer->rowsWritten += rows;
+        return fwrite(bytes, 1, rowValues * rows, writer->file) == rowValues * rows ? 0 : -1;
+    }
+
+    size_t stride = rowValues + 1;
+    unsigned char *filtered = stream_scratch(writer, stride * rows);
+    if (filtered == NULL) return -1;
+
+    for (int r = 0; r < rows; r++) {
+        unsigned char *row = filtered + r * stride;
+        const float *src = rgb + r * rowValues;
+        unsigned char previous[3] = {0, 0, 0};
+
+        row[0] = 1;
+        for (size_t i = 0; i < rowValues; i++) {
+            unsigned char value = to_byte(src[i]);
+            row[1 + i] = (unsigned char)(value - previous[i % 3]);
+            previous[i % 3] = value;
+        }
+    }
+
+    writer->adler = adler32_update(writer->adler, filtered, stride * rows);
+    deflate_write(&writer->deflate, filtered, stride * rows);
+    writer->rowsWritten += rows;
+    if (writer->deflate.failed ||
+        stream_png_chunk(writer->file, "IDAT", writer->deflate.out, writer->deflate.outLength) != 0) {
+        return -1;
+    }
+    deflate_drain(&writer->deflate);
+    return 0;
+}
+
+int stream_close(stream_writer_t *writer) {
+    int status = writer->rowsWritten == writer->height ? 0 : -1;
+
+    if (writer->file == NULL) return -1;
+
+    if (writer->format == STREAM_PNG) {
+        unsigned char adler[4];
+        stream_put_u32(adler, writer->adler);
+        deflate_finish(&writer->deflate);
+        deflate_reserve(&writer->deflate, 4);
+        if (!writer->deflate.failed) {
+            memcpy(writer->deflate.out + writer->deflate.outLength, adler, 4);
+            writer->deflate.outLength += 4;
+        }
+        if (writer->deflate.failed ||
+            stream_png_chunk(writer->file, "IDAT", writer->deflate.out, writer->deflate.outLength) != 0 ||
+            stream_png_chunk(writer->file, "IEND", NULL, 0) != 0) {
+            status = -1;
+        }
+        deflate_destroy(&writer->deflate);
+    }
+
+    if (fclose(writer->file) != 0) status = -1;
+    writer->file = NULL;
+    memory_add(MEMORY_OUTPUT, -(long long)writer->scratchSize);
+    free(writer->scratch);
+    writer->scratch = NULL;
+    writer->scratchSize = 0;
+    return status;
+}
+
+void *stream_async_worker(void *arg) {
+    stream_async_t *stream = (stream_async_t *)arg;
+    stream_band_t *band;
+
+    while ((band = (stream_band_t *)queue_pop(&stream->queue)) != NULL) {
+        if (!stream->error && stream_write_rows(&stream->writer, band->rgb, band->rows) != 0) {
+            stream->error = 1;
+        }
+        memory_add(MEMORY_QUEUE, -(long long)(sizeof(float) * stream->writer.width * 3 * band->rows));
+        free(band->rgb);
+        free(band);
+    }
+    return NULL;
+}
+
+int stream_async_open(stream_async_t *stream, const char *path, int width, int height, int depth) {
+    stream->error = 0;
+    if (stream_open(&stream->writer, path, width, height) != 0) {
+        if (stream->writer.file != NULL) stream_close(&stream->writer);
+        return -1;
+    }
+    if (queue_init(&stream->queue, depth) != 0) {
+        stream_close(&stream->writer);
+        return -1;
+    }
+    if (pthread_create(&stream->thread, NULL, stream_async_worker, stream) != 0) {
+        queue_destroy(&stream->queue);
+        stream_close(&stream->writer);
+        return -1;
+    }
+    return 0;
+}
+
+int stream_async_submit(stream_async_t *stream, const float *rgb, int rows) {
+    size_t bytes = sizeof(float) * stream->writer.width * 3 * rows;
+    stream_band_t *band = malloc(sizeof(stream_band_t));
+
+    if (band == NULL) return -1;
+    band->rgb = malloc(bytes);
+    band->rows = rows;
+    if (band->rgb == NULL) {
+        free(band);
+        return -1;
+    }
+    memcpy(band->rgb, rgb, bytes);
+    memory_add(MEMORY_QUEUE, bytes);
+
+    if (queue_push(&stream->queue, band) != 0) {
+        memory_add(MEMORY_QUEUE, -(long long)bytes);
+        free(band->rgb);
+        free(band);
+        return -1;
+    }
+    return 0;
+}
+
+int stream_async_close(stream_async_t *stream) {
+    queue_close(&stream->queue);
+    pthread_join(stream->thread, NULL);
+    queue_destroy(&stream->queue);
+    if (stream_close(&stream->writer) != 0) stream->error = 1;
+    return stream->error ? -1 : 0;
+}
+
+#endif
@@ -0,0 +1,465 @@
+#ifndef EZ_TEXTURE_H
+#define EZ_TEXTURE_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <raylib.h>
+#include <ez_memory.h>
+#include <ez_tracer.h>
+
+/*
+ * Image textures are converted once into a tiled, mip-mapped file next to
+ * the source (<image>.ezt) and then read a tile at a time. All textures share
+ * one fixed-size LRU cache of 32x32 RGBA8 tiles, so the resident footprint
+ * does not depend on how many or how large the textures are.
+ *
+ *   header      texture_file_header_t
+ *   tiles       level 0 row-major, then level 1, ... from TEXTURE_DATA_OFFSET
+ *
+ * Edge tiles are padded by repeating the last row and column.
+ *
+ * A lookup pins each tile of its footprint once under the cache lock and reads
+ * the texels without it; a pinned tile is never chosen for eviction.
+ */
+#define TEXTURE_MAGIC 0x58545a45U
+#define TEXTURE_VERSION 1
+#define TEXTURE_TILE_SIZE 32
+#define TEXTURE_TILE_BYTES (TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE * 4)
+#define TEXTURE_MAX_LEVELS 24
+#define TEXTURE_DATA_OFFSET 4096
+#define TEXTURE_PATH_LENGTH 1024
+
+typedef struct {
+    int width;
+    int height;
+    int columns;
+    int rows;
+    unsigned long long firstTile;
+} texture_level_t;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    int width;
+    int height;
+    int levels;
+    int tileSize;
+    texture_level_t level[TEXTURE_MAX_LEVELS];
+} texture_file_header_t;
+
+typedef struct {
+    char path[TEXTURE_PATH_LENGTH];
+    int fd;
+    texture_file_header_t header;
+} texture_t;
+
+typedef struct {
+    int texture;
+    int level;
+    int tile;
+    int next;
+    int loading;
+    atomic_int pins;
+    unsigned long long lastUse;
+    unsigned char *texels;
+} texture_slot_t;
+
+typedef struct {
+    unsigned long long lookups;
+    unsigned long long misses;
+    unsigned long long evictions;
+} texture_stats_t;
+
+typedef struct {
+    texture_t *textures;
+    int count;
+    int capacity;
+    texture_slot_t *slots;
+    int slotCount;
+    int *buckets;
+    int bucketCount;
+    unsigned char *memory;
+    unsigned long long clock;
+    atomic_int waiters;
+    texture_stats_t stats;
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+} texture_cache_t;
+
+void texture_levels(texture_file_header_t *header, int width, int height) {
+    unsigned long long tiles = 0;
+
+    memset(header, 0, sizeof(*header));
+    header->magic = TEXTURE_MAGIC;
+    header->version = TEXTURE_VERSION;
+    header->width = width;
+    header->height = height;
+    header->tileSize = TEXTURE_TILE_SIZE;
+
+    for (int l = 0; l < TEXTURE_MAX_LEVELS; l++) {
+        texture_level_t *level = &header->level[l];
+        level->width = width;
+        level->height = height;
+        level->columns = (width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        level->rows = (height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        level->firstTile = tiles;
+        tiles += (unsigned long long)level->columns * level->rows;
+        header->levels = l + 1;
+        if (width == 1 && height == 1) break;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+}
+
+/* Converts any image raylib can load into the tiled format; the mip chain is box filtered. */
+int texture_build(const char *source, const char *path) {
+    texture_file_header_t header;
+    Image image = LoadImage(source);
+    Color *pixels;
+    unsigned char *level;
+    unsigned char tile[TEXTURE_TILE_BYTES];
+    int status = 0;
+    FILE *file;
+
+    if (image.data == NULL || image.width <= 0 || image.height <= 0) return -1;
+    pixels = LoadImageColors(image);
+    level = malloc((size_t)image.width * image.height * 4);
+    if (pixels == NULL || level == NULL) {
+        UnloadImageColors(pixels);
+        UnloadImage(image);
+        free(level);
+        return -1;
+    }
+    memcpy(level, pixels, (size_t)image.width * image.height * 4);
+    memory_add(MEMORY_TEXTURE, (long long)image.width * image.height * 4);
+    UnloadImageColors(pixels);
+    texture_levels(&header, image.width, image.height);
+    UnloadImage(image);
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        free(level);
+        memory_add(MEMORY_TEXTURE, -(long long)header.width * header.height * 4);
+        return -1;
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fseeko(file, TEXTURE_DATA_OFFSET, SEEK_SET) != 0) {
+        status = -1;
+    }
+
+    for (int l = 0; l < header.levels && status == 0; l++) {
+        texture_level_t *info = &header.level[l];
+
+        if (l > 0) {
+            texture_level_t *parent = &header.level[l - 1];
+            for (int y = 0; y < info->height; y++) {
+                for (int x = 0; x < info->width; x++) {
+                    int x0 = 2 * x < parent->width ? 2 * x : parent->width - 1;
+                    int y0 = 2 * y < parent->height ? 2 * y : parent->height - 1;
+                    int x1 = x0 + 1 < parent->width ? x0 + 1 : x0;
+                    int y1 = y0 + 1 < parent->height ? y0 + 1 : y0;
+                    for (int c = 0; c < 4; c++) {
+                        int sum = level[((size_t)y0 * parent->width + x0) * 4 + c] + level[((size_t)y0 * parent->width + x1) * 4 + c] +
+                                  level[((size_t)y1 * parent->width + x0) * 4 + c] + level[((size_t)y1 * parent->width + x1) * 4 + c];
+                        level[((size_t)y * info->width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+
+        for (int ty = 0; ty < info->rows && status == 0; ty++) {
+            for (int tx = 0; tx < info->columns && status == 0; tx++) {
+                for (int y = 0; y < TEXTURE_TILE_SIZE; y++) {
+                    int sy = ty * TEXTURE_TILE_SIZE + y < info->height ? ty * TEXTURE_TILE_SIZE + y : info->height - 1;
+                    for (int x = 0; x < TEXTURE_TILE_SIZE; x++) {
+                        int sx = tx * TEXTURE_TILE_SIZE + x < info->width ? tx * TEXTURE_TILE_SIZE + x : info->width - 1;
+                        memcpy(tile + (y * TEXTURE_TILE_SIZE + x) * 4, level + ((size_t)sy * info->width + sx) * 4, 4);
+                    }
+                }
+                if (fwrite(tile, 1, TEXTURE_TILE_BYTES, file) != TEXTURE_TILE_BYTES) status = -1;
+            }
+        }
+    }
+
+    if (fclose(file) != 0) status = -1;
+    if (status != 0) remove(path);
+    free(level);
+    memory_add(MEMORY_TEXTURE, -(long long)header.width * header.height * 4);
+    return status;
+}
+
+int texture_open(texture_t *texture, const char *source) {
+    struct stat sourceInfo, tiledInfo;
+    char tiled[TEXTURE_PATH_LENGTH + 4];
+
+    memset(texture, 0, sizeof(*texture));
+    texture->fd = -1;
+    if (strlen(source) >= TEXTURE_PATH_LENGTH) return -1;
+    strcpy(texture->path, source);
+    snprintf(tiled, sizeof(tiled), "%s.ezt", source);
+
+    if (stat(source, &sourceInfo) == 0 &&
+        (stat(tiled, &tiledInfo) != 0 || tiledInfo.st_mtime < sourceInfo.st_mtime) &&
+        texture_build(source, tiled) != 0) {
+        return -1;
+    }
+
+    texture->fd = open(tiled, O_RDONLY);
+    if (texture->fd < 0) return -1;
+    if (pread(texture->fd, &texture->header, sizeof(texture->header), 0) != (ssize_t)sizeof(texture->header) ||
+        texture->header.magic != TEXTURE_MAGIC || texture->header.version != TEXTURE_VERSION ||
+        texture->header.tileSize != TEXTURE_TILE_SIZE || texture->header.levels < 1 ||
+        texture->header.levels > TEXTURE_MAX_LEVELS) {
+        close(texture->fd);
+        texture->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+size_t texture_cache_bytes(texture_cache_t *cache) {
+    return (size_t)cache->slotCount * (sizeof(texture_slot_t) + TEXTURE_TILE_BYTES) + sizeof(int) * cache->bucketCount +
+           sizeof(texture_t) * cache->capacity;
+}
+
+int texture_cache_create(texture_cache_t *cache, size_t budget) {
+    memset(cache, 0, sizeof(*cache));
+    cache->slotCount = (int)(budget / TEXTURE_TILE_BYTES);
+    if (cache->slotCount < 16) cache->slotCount = 16;
+    cache->bucketCount = cache->slotCount * 2;
+    cache->slots = calloc(cache->slotCount, sizeof(texture_slot_t));
+    cache->buckets = malloc(sizeof(int) * cache->bucketCount);
+    cache->memory = malloc((size_t)cache->slotCount * TEXTURE_TILE_BYTES);
+    if (cache->slots == NULL || cache->buckets == NULL || cache->memory == NULL) {
+        free(cache->slots);
+        free(cache->buckets);
+        free(cache->memory);
+        return -1;
+    }
+
+    for (int b = 0; b < cache->bucketCount; b++) cache->buckets[b] = -1;
+    for (int s = 0; s < cache->slotCount; s++) {
+        cache->slots[s].texture = -1;
+        cache->slots[s].next = -1;
+        cache->slots[s].texels = cache->memory + (size_t)s * TEXTURE_TILE_BYTES;
+        atomic_init(&cache->slots[s].pins, 0);
+    }
+    atomic_init(&cache->waiters, 0);
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->loaded, NULL);
+    memory_add(MEMORY_TEXTURE, texture_cache_bytes(cache));
+    return 0;
+}
+
+/* Returns the index of the texture for source, opening it on first use. Not safe while sampling. */
+int texture_cache_add(texture_cache_t *cache, const char *source) {
+    for (int t = 0; t < cache->count; t++) {
+        if (strcmp(cache->textures[t].path, source) == 0) return cache->textures[t].fd >= 0 ? t : -1;
+    }
+    if (cache->count == cache->capacity) {
+        int capacity = cache->capacity ? cache->capacity * 2 : 8;
+        texture_t *grown = realloc(cache->textures, sizeof(texture_t) * capacity);
+        if (grown == NULL) return -1;
+        memory_add(MEMORY_TEXTURE, (long long)sizeof(texture_t) * (capacity - cache->capacity));
+        cache->textures = grown;
+        cache->capacity = capacity;
+    }
+    texture_open(&cache->textures[cache->count], source);
+    cache->count++;
+    return cache->textures[cache->count - 1].fd >= 0 ? cache->count - 1 : -1;
+}
+
+unsigned int texture_hash(int texture, int level, int tile) {
+    unsigned int h = (unsigned int)texture * 0x9e3779b1U ^ (unsigned int)level * 0x85ebca6bU ^ (unsigned int)tile * 0xc2b2ae35U;
+    return h ^ (h >> 15);
+}
+
+void texture_unlink(texture_cache_t *cache, int slot) {
+    texture_slot_t *entry = &cache->slots[slot];
+    int *link = &cache->buckets[texture_hash(entry->texture, entry->level, entry->tile) % cache->bucketCount];
+
+    while (*link != slot) link = &cache->slots[*link].next;
+    *link = entry->next;
+    entry->next = -1;
+}
+
+/* Returns the slot holding a tile, paging it in if needed, pinned until texture_unpin. */
+texture_slot_t *texture_pin(texture_cache_t *cache, int texture, int level, int tile) {
+    texture_t *tex = &cache->textures[texture];
+    texture_level_t *info = &tex->header.level[level];
+    unsigned int bucket = texture_hash(texture, level, tile) % cache->bucketCount;
+    texture_slot_t *entry;
+    int victim = -1;
+    int waiting = 0;
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stats.lookups++;
+    for (;;) {
+        int s = cache->buckets[bucket];
+        while (s >= 0 && (cache->slots[s].texture != texture || cache->slots[s].level != level || cache->slots[s].tile != tile)) {
+            s = cache->slots[s].next;
+        }
+        if (s >= 0) {
+            entry = &cache->slots[s];
+            if (entry->loading) {
+                pthread_cond_wait(&cache->loaded, &cache->lock);
+                continue;
+            }
+            atomic_fetch_add(&entry->pins, 1);
+            entry->lastUse = ++cache->clock;
+            if (waiting) atomic_fetch_sub(&cache->waiters, 1);
+            pthread_mutex_unlock(&cache->lock);
+            return entry;
+        }
+
+        for (s = 0; s < cache->slotCount; s++) {
+            texture_slot_t *candidate = &cache->slots[s];
+            if (candidate->loading || atomic_load(&candidate->pins) > 0) continue;
+            if (candidate->texture < 0) {
+                victim = s;
+                break;
+            }
+            if (victim < 0 || candidate->lastUse < cache->slots[victim].lastUse) victim = s;
+        }
+        if (victim >= 0) break;
+        /* Announce the wait and scan again, so an unpin racing with the scan still wakes us. */
+        if (!waiting) {
+            atomic_fetch_add(&cache->waiters, 1);
+            waiting = 1;
+            continue;
+        }
+        pthread_cond_wait(&cache->loaded, &cache->lock);
+    }
+    if (waiting) atomic_fetch_sub(&cache->waiters, 1);
+
+    entry = &cache->slots[victim];
+    if (entry->texture >= 0) {
+        texture_unlink(cache, victim);
+        cache->stats.evictions++;
+    }
+    entry->texture = texture;
+    entry->level = level;
+    entry->tile = tile;
+    entry->loading = 1;
+    atomic_store(&entry->pins, 1);
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = victim;
+    cache->stats.misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    off_t position = TEXTURE_DATA_OFFSET + (off_t)(info->firstTile + tile) * TEXTURE_TILE_BYTES;
+    if (pread(tex->fd, entry->texels, TEXTURE_TILE_BYTES, position) != TEXTURE_TILE_BYTES) {
+        memset(entry->texels, 0, TEXTURE_TILE_BYTES);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    entry->loading = 0;
+    entry->lastUse = ++cache->clock;
+    pthread_cond_broadcast(&cache->loaded);
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+void texture_unpin(texture_cache_t *cache, texture_slot_t *entry) {
+    if (atomic_fetch_sub(&entry->pins, 1) == 1 && atomic_load(&cache->waiters) > 0) {
+        pthread_mutex_lock(&cache->lock);
+        pthread_cond_broadcast(&cache->loaded);
+        pthread_mutex_unlock(&cache->lock);
+    }
+}
+
+/* The four texels usually share a tile; each distinct tile is pinned once and read without the lock. */
+Color3 texture_bilinear(texture_cache_t *cache, int texture, int level, float u, float v) {
+    texture_level_t *info = &cache->textures[texture].header.level[level];
+    float fx = (u - floorf(u)) * info->width - 0.5f;
+    float fy = (v - floorf(v)) * info->height - 0.5f;
+    int x0 = (int)floorf(fx);
+    int y0 = (int)floorf(fy);
+    float ax = fx - x0;
+    float ay = fy - y0;
+    float weights[4] = {(1 - ax) * (1 - ay), ax * (1 - ay), (1 - ax) * ay, ax * ay};
+    int tiles[4], offsets[4];
+    unsigned char texels[4][4];
+    Color3 color = {0, 0, 0};
+
+    for (int k = 0; k < 4; k++) {
+        int x = (x0 + (k & 1)) % info->width;
+        int y = y0 + (k >> 1);
+        if (x < 0) x += info->width;
+        y = y < 0 ? 0 : y >= info->height ? info->height - 1 : y;
+        tiles[k] = (y / TEXTURE_TILE_SIZE) * info->columns + x / TEXTURE_TILE_SIZE;
+        offsets[k] = ((y % TEXTURE_TILE_SIZE) * TEXTURE_TILE_SIZE + x % TEXTURE_TILE_SIZE) * 4;
+    }
+
+    for (int k = 0; k < 4; k++) {
+        int seen = 0;
+        for (int j = 0; j < k; j++) seen |= tiles[j] == tiles[k];
+        if (seen) continue;
+        texture_slot_t *entry = texture_pin(cache, texture, level, tiles[k]);
+        for (int j = k; j < 4; j++) {
+            if (tiles[j] == tiles[k]) memcpy(texels[j], entry->texels + offsets[j], 4);
+        }
+        texture_unpin(cache, entry);
+    }
+
+    for (int k = 0; k < 4; k++) {
+        color.x += weights[k] * texels[k][0];
+        color.y += weights[k] * texels[k][1];
+        color.z += weights[k] * texels[k][2];
+    }
+    return constant_multiply(&color, 1.0f / 255);
+}
+
+/*
+ * Trilinear lookup. du and dv are the extent of the ray's footprint in
+ * texture space (u and v in [0, 1)); the larger one in texels picks the pair
+ * of mip levels to blend.
+ */
+Color3 texture_sample(texture_cache_t *cache, int texture, float u, float v, float du, float dv) {
+    texture_file_header_t *header = &cache->textures[texture].header;
+    float texels = fmaxf(du * header->width, dv * header->height);
+    float lod = texels > 1 ? log2f(texels) : 0;
+    int level = (int)lod;
+    float blend = lod - level;
+
+    if (level >= header->levels - 1) {
+        return texture_bilinear(cache, texture, header->levels - 1, u, v);
+    }
+    Color3 fine = texture_bilinear(cache, texture, level, u, v);
+    if (blend <= 0) return fine;
+    Color3 coarse = texture_bilinear(cache, texture, level + 1, u, v);
+    fine = constant_multiply(&fine, 1 - blend);
+    coarse = constant_multiply(&coarse, blend);
+    return add(&fine, &coarse);
+}
+
+texture_stats_t texture_take_stats(texture_cache_t *cache) {
+    texture_stats_t stats;
+    pthread_mutex_lock(&cache->lock);
+    stats = cache->stats;
+    memset(&cache->stats, 0, sizeof(cache->stats));
+    pthread_mutex_unlock(&cache->lock);
+    return stats;
+}
+
+void texture_cache_destroy(texture_cache_t *cache) {
+    if (cache->slots != NULL) memory_add(MEMORY_TEXTURE, -(long long)texture_cache_bytes(cache));
+    for (int t = 0; t < cache->count; t++) {
+        if (cache->textures[t].fd >= 0) close(cache->textures[t].fd);
+    }
+    free(cache->textures);
+    free(cache->slots);
+    free(cache->buckets);
+    free(cache->memory);
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->loaded);
+    memset(cache, 0, sizeof(*cache));
+}
+
+#endif
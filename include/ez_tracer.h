@@ -1,3 +1,6 @@
+#ifndef EZ_TRACER_H
+#define EZ_TRACER_H
+
 #include <math.h>
 
 typedef struct {
@@ -70,3 +73,5 @@ Vec3 sub(Vec3 *veca, Vec3 *vecb) {
     Vec3 negatedVec = negate(vecb);
     return add(veca, &negatedVec);
 }
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef EZ_VIDEO_H
+#define EZ_VIDEO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ez_memory.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Uncompressed video stream for piping into an encoder, e.g.
+ *   ./out --frames 240 --video - | ffmpeg -i - out.mp4
+ * Y4M frames are BT.601 limited range 4:2:0 (C420jpeg siting); raw frames are
+ * packed rgb24. Frames can be handed in from several threads and are written
+ * strictly in frame order; colour conversion runs before waiting for the turn.
+ * video_resume appends to a file left by an interrupted run.
+ */
+#define VIDEO_Y4M_HEADER "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n"
+#define VIDEO_Y4M_FRAME "FRAME\n"
+
+typedef enum {
+    VIDEO_Y4M,
+    VIDEO_RGB
+} video_format;
+
+typedef struct {
+    FILE *file;
+    video_format format;
+    int width;
+    int height;
+    int fps;
+    int nextFrame;
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+} video_writer_t;
+
+void video_rgba_to_yuv_scalar(const unsigned char *rgba, unsigned char *y, unsigned char *u, unsigned char *v, int n) {
+    for (int i = 0; i < n; i++) {
+        int r = rgba[4*i];
+        int g = rgba[4*i + 1];
+        int b = rgba[4*i + 2];
+        y[i] = (unsigned char)(((66*r + 129*g + 25*b + 128) >> 8) + 16);
+        u[i] = (unsigned char)((112*b - 38*r - 74*g + 32896) >> 8);
+        v[i] = (unsigned char)((112*r - 94*g - 18*b + 32896) >> 8);
+    }
+}
+
+#ifdef __SSE2__
+__m128i video_channel(__m128i lo, __m128i hi, int shift) {
+    __m128i mask = _mm_set1_epi32(0xff);
+    __m128i a = _mm_and_si128(_mm_srli_epi32(lo, shift), mask);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(hi, shift), mask);
+    return _mm_packs_epi32(a, b);
+}
+
+__m128i video_weigh(__m128i a, int wa, __m128i b, int wb, __m128i c, int wc, int bias) {
+    __m128i sum = _mm_mullo_epi16(a, _mm_set1_epi16((short)wa));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16((short)wb)));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(c, _mm_set1_epi16((short)wc)));
+    sum = _mm_add_epi16(sum, _mm_set1_epi16((short)bias));
+    return _mm_srli_epi16(sum, 8);
+}
+#endif
+
+void video_rgba_to_yuv(const unsigned char *rgba, unsigned char *y, unsigned char *u, unsigned char *v, int n) {
+    int i = 0;
+#ifdef __SSE2__
+    /* 16 bit lanes wrap, but every final sum lies in [0, 65535] before the shift. */
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(rgba + 4*i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(rgba + 4*i + 16));
+        __m128i r = video_channel(lo, hi, 0);
+        __m128i g = video_channel(lo, hi, 8);
+        __m128i b = video_channel(lo, hi, 16);
+        __m128i luma = _mm_add_epi16(video_weigh(r, 66, g, 129, b, 25, 128), _mm_set1_epi16(16));
+        __m128i cb = video_weigh(b, 112, r, -38, g, -74, 32896);
+        __m128i cr = video_weigh(r, 112, g, -94, b, -18, 32896);
+        _mm_storel_epi64((__m128i *)(y + i), _mm_packus_epi16(luma, zero));
+        _mm_storel_epi64((__m128i *)(u + i), _mm_packus_epi16(cb, zero));
+        _mm_storel_epi64((__m128i *)(v + i), _mm_packus_epi16(cr, zero));
+    }
+#endif
+    video_rgba_to_yuv_scalar(rgba + 4*i, y + i, u + i, v + i, n - i);
+}
+
+size_t video_frame_bytes(video_writer_t *video) {
+    if (video->format == VIDEO_RGB) {
+        return (size_t)video->width * video->height * 3;
+    }
+    size_t chroma = (size_t)((video->width + 1) / 2) * ((video->height + 1) / 2);
+    return (size_t)video->width * video->height + 2 * chroma;
+}
+
+void video_convert(video_writer_t *video, const unsigned char *rgba, unsigned char *out) {
+    int w = video->width;
+    int h = video->height;
+    int cw = (w + 1) / 2;
+    int ch = (h + 1) / 2;
+
+    if (video->format == VIDEO_RGB) {
+        for (size_t p = 0; p < (size_t)w * h; p++) {
+            memcpy(out + 3*p, rgba + 4*p, 3);
+        }
+        return;
+    }
+
+    unsigned char *luma = out;
+    unsigned char *cbPlane = out + (size_t)w * h;
+    unsigned char *crPlane = cbPlane + (size_t)cw * ch;
+    unsigned char *rows = malloc((size_t)w * 4);
+    unsigned char *cb[2] = {rows, rows + w};
+    unsigned char *cr[2] = {rows + 2 * w, rows + 3 * w};
+
+    if (rows == NULL) {
+        memset(out, 128, video_frame_bytes(video));
+        return;
+    }
+
+    for (int y = 0; y < h; y += 2) {
+        int y1 = y + 1 < h ? y + 1 : y;
+        video_rgba_to_yuv(rgba + (size_t)y * w * 4, luma + (size_t)y * w, cb[0], cr[0], w);
+        video_rgba_to_yuv(rgba + (size_t)y1 * w * 4, luma + (size_t)y1 * w, cb[1], cr[1], w);
+        for (int x = 0; x < cw; x++) {
+            int x0 = 2 * x;
+            int x1 = x0 + 1 < w ? x0 + 1 : x0;
+            size_t c = (size_t)(y / 2) * cw + x;
+            cbPlane[c] = (unsigned char)((cb[0][x0] + cb[0][x1] + cb[1][x0] + cb[1][x1] + 2) >> 2);
+            crPlane[c] = (unsigned char)((cr[0][x0] + cr[0][x1] + cr[1][x0] + cr[1][x1] + 2) >> 2);
+        }
+    }
+    free(rows);
+}
+
+int video_open(video_writer_t *video, const char *path, video_format format, int width, int height, int fps) {
+    memset(video, 0, sizeof(*video));
+    video->format = format;
+    video->width = width;
+    video->height = height;
+    video->fps = fps;
+
+    signal(SIGPIPE, SIG_IGN);
+    video->file = strcmp(path, "-") == 0 ? stdout : fopen(path, "wb");
+    if (video->file == NULL) return -1;
+
+    pthread_mutex_init(&video->lock, NULL);
+    pthread_cond_init(&video->turn, NULL);
+    if (format == VIDEO_Y4M &&
+        fprintf(video->file, VIDEO_Y4M_HEADER, width, height, fps) < 0) {
+        video->failed = 1;
+    }
+    return 0;
+}
+
+/*
+ * Reopens a file written by video_open with the same settings so frames from
+ * frame onwards are appended. The Y4M header must match and the file must
+ * hold frame complete frames; anything after them was written after the
+ * checkpoint, is rendered again and gets cut off. Standard output cannot be
+ * resumed.
+ */
+int video_resume(video_writer_t *video, const char *path, video_format format, int width, int height, int fps, int frame) {
+    char expected[128];
+    char header[128];
+    long long start = 0;
+    long long end;
+    struct stat info;
+
+    memset(video, 0, sizeof(*video));
+    video->format = format;
+    video->width = width;
+    video->height = height;
+    video->fps = fps;
+    if (strcmp(path, "-") == 0) return -1;
+    video->file = fopen(path, "r+b");
+    if (video->file == NULL) return -1;
+
+    if (format == VIDEO_Y4M) {
+        snprintf(expected, sizeof(expected), VIDEO_Y4M_HEADER, width, height, fps);
+        if (fgets(header, sizeof(header), video->file) == NULL || strcmp(header, expected) != 0) {
+            fclose(video->file);
+            video->file = NULL;
+            return -1;
+        }
+        start = (long long)strlen(expected);
+    }
+    end = start + (long long)frame * (long long)(video_frame_bytes(video) +
+                                                 (format == VIDEO_Y4M ? strlen(VIDEO_Y4M_FRAME) : 0));
+    if (fstat(fileno(video->file), &info) != 0 || info.st_size < end || ftruncate(fileno(video->file), end) != 0 ||
+        fseeko(video->file, end, SEEK_SET) != 0) {
+        fclose(video->file);
+        video->file = NULL;
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    video->nextFrame = frame;
+    pthread_mutex_init(&video->lock, NULL);
+    pthread_cond_init(&video->turn, NULL);
+    return 0;
+}
+
+int video_write_frame(video_writer_t *video, int frame, const unsigned char *rgba) {
+    size_t bytes = video_frame_bytes(video);
+    unsigned char *data = malloc(bytes);
+
+    if (data != NULL) {
+        memory_add(MEMORY_OUTPUT, bytes);
+        video_convert(video, rgba, data);
+    }
+
+    pthread_mutex_lock(&video->lock);
+    while (video->nextFrame != frame) {
+        pthread_cond_wait(&video->turn, &video->lock);
+    }
+    if (data == NULL ||
+        (video->format == VIDEO_Y4M && fputs(VIDEO_Y4M_FRAME, video->file) < 0) ||
+        fwrite(data, 1, bytes, video->file) != bytes ||
+        fflush(video->file) != 0) {
+        video->failed = 1;
+    }
+    video->nextFrame++;
+    pthread_cond_broadcast(&video->turn);
+    pthread_mutex_unlock(&video->lock);
+
+    if (data != NULL) memory_add(MEMORY_OUTPUT, -(long long)bytes);
+    free(data);
+    return video->failed ? -1 : 0;
+}
+
+int video_close(video_writer_t *video) {
+    int status = video->failed ? -1 : 0;
+
+    if (video->file == NULL) return -1;
+    if (video->file == stdout) {
+        if (fflush(stdout) != 0) status = -1;
+    } else if (fclose(video->file) != 0) {
+        status = -1;
+    }
+    video->file = NULL;
+    pthread_mutex_destroy(&video->lock);
+    pthread_cond_destroy(&video->turn);
+    return status;
+}
+
+#endif
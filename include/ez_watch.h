@@ -0,0 +1,119 @@
+#ifndef EZ_WATCH_H
+#define EZ_WATCH_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/inotify.h>
+#endif
+
+/*
+ * Non-blocking change detection for a single file. On Linux the containing
+ * directory is watched with inotify, so editors that save by writing a new
+ * file and renaming it over the old one are still seen. Elsewhere the file's
+ * modification time and size are polled.
+ */
+#define WATCH_EVENT_BUFFER 4096
+
+typedef struct {
+    char *path;
+    const char *name;
+    int fd;
+    struct timespec mtime;
+    off_t size;
+} watch_t;
+
+void watch_stat(watch_t *watch, struct timespec *mtime, off_t *size) {
+    struct stat info;
+    memset(mtime, 0, sizeof(*mtime));
+    *size = -1;
+    if (stat(watch->path, &info) == 0) {
+#ifdef __APPLE__
+        *mtime = info.st_mtimespec;
+#else
+        *mtime = info.st_mtim;
+#endif
+        *size = info.st_size;
+    }
+}
+
+int watch_init(watch_t *watch, const char *path) {
+    memset(watch, 0, sizeof(*watch));
+    watch->fd = -1;
+    watch->path = strdup(path);
+    if (watch->path == NULL) return -1;
+
+    const char *slash = strrchr(watch->path, '/');
+    watch->name = slash != NULL ? slash + 1 : watch->path;
+    watch_stat(watch, &watch->mtime, &watch->size);
+
+#ifdef __linux__
+    char *directory = strdup(watch->path);
+    char *cut = directory != NULL ? strrchr(directory, '/') : NULL;
+
+    if (directory == NULL) return 0;
+    if (cut == NULL) {
+        free(directory);
+        directory = strdup(".");
+    } else {
+        cut[cut == directory ? 1 : 0] = '\0';
+    }
+
+    watch->fd = directory != NULL ? inotify_init1(IN_NONBLOCK | IN_CLOEXEC) : -1;
+    if (watch->fd >= 0 && inotify_add_watch(watch->fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        close(watch->fd);
+        watch->fd = -1;
+    }
+    free(directory);
+#endif
+    return 0;
+}
+
+int watch_poll(watch_t *watch) {
+    struct timespec mtime;
+    off_t size;
+
+    watch_stat(watch, &mtime, &size);
+    if (mtime.tv_sec == watch->mtime.tv_sec && mtime.tv_nsec == watch->mtime.tv_nsec && size == watch->size) {
+        return 0;
+    }
+    watch->mtime = mtime;
+    watch->size = size;
+    return size >= 0;
+}
+
+/* Returns 1 when the file was written since the last call. Never blocks. */
+int watch_changed(watch_t *watch) {
+#ifdef __linux__
+    if (watch->fd >= 0) {
+        char buffer[WATCH_EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+        int changed = 0;
+        ssize_t length;
+
+        while ((length = read(watch->fd, buffer, sizeof(buffer))) > 0) {
+            for (char *p = buffer; p < buffer + length; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+                struct inotify_event *event = (struct inotify_event *)p;
+                if (event->len > 0 && strcmp(event->name, watch->name) == 0) changed = 1;
+            }
+        }
+        if (changed) watch_stat(watch, &watch->mtime, &watch->size);
+        return changed;
+    }
+#endif
+    return watch_poll(watch);
+}
+
+void watch_destroy(watch_t *watch) {
+#ifdef __linux__
+    if (watch->fd >= 0) close(watch->fd);
+#endif
+    free(watch->path);
+    watch->path = NULL;
+    watch->fd = -1;
+}
+
+#endif
@@ -1,5 +1,33 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
 #include <raylib.h>
+#define RAYGUI_IMPLEMENTATION
+#include <raygui.h>
 #include <ez_tracer.h>
+#include <ez_framebuffer.h>
+#include <ez_parallel.h>
+#include <ez_adaptive.h>
+#include <ez_random.h>
+#include <ez_sampler.h>
+#include <ez_stream.h>
+#include <ez_hdr.h>
+#include <ez_pipeline.h>
+#include <ez_video.h>
+#include <ez_checkpoint.h>
+#include <ez_scene.h>
+#include <ez_watch.h>
+#include <ez_texture.h>
+#include <ez_profile.h>
+#include <ez_stats.h>
+#include <ez_regress.h>
+#include <ez_perf.h>
+#include <ez_memory.h>
+#include <ez_accel.h>
+#include <ez_framecache.h>
+#include <ez_denoise.h>
 
 #define SCREEN_WIDTH 1920
 #define SCREEN_HEIGHT 1080
@@ -8,14 +36,142 @@
 #define CAMERA_VIEWPORT_DISTANCE 1
 #define T_MAX 32768
 #define FPS 60
+#define TILE_SIZE 32
+#define MIN_SAMPLES 4
+#define MAX_SAMPLES 64
+#define SAMPLES_PER_PASS 4
+#define ADAPTIVE_THRESHOLD 0.02f
+#define STREAM_QUEUE_DEPTH 2
+#define IO_THREADS 2
+#define EXPORT_QUEUE_DEPTH 1
+#define MAX_PATH_LENGTH 1024
+#define CHECKPOINT_INTERVAL 300
+#define MAX_DEPTH 3
+#define SHADOW_EPSILON 0.001f
+#define CLUSTER_BUDGET_MB 512
+#define TEXTURE_CACHE_MB 64
+#define FRAME_CACHE_MB 1024
+#define OVERLAY_MAX_SAMPLES 256
+#define OVERLAY_MAX_DEPTH 8
 
 const Vec3 ORIGIN = (Vec3){0, 0, 0};
+const Color3 DEFAULT_BACKGROUND = (Color3){1, 1, 1};
 
 typedef struct {
     Vec3 center;
-    float radius;
-    Color3 color;
-} sphere_t;
+    unsigned int material;
+} sphere_hit_t;
+
+typedef struct {
+    Color3 albedo;
+    Vec3 normal;
+    float depth;
+} hit_t;
+
+typedef struct {
+    float width;
+    float spread;
+} ray_cone_t;
+
+typedef struct {
+    int width;
+    int height;
+    int threads;
+    int tileSize;
+    adaptive_settings_t sampling;
+    fb_format bufferFormat;
+    const char *output;
+    const char *heatmap;
+    const char *costOutput;
+    const char *hdrOutput;
+    exr_compression hdrCompression;
+    int streaming;
+    int frames;
+    int ioThreads;
+    int exportDepth;
+    const char *videoOutput;
+    video_format videoFormat;
+    const char *checkpointPath;
+    double checkpointInterval;
+    int resume;
+    int maxDepth;
+    const char *scenePath;
+    int interactive;
+    size_t clusterBudget;
+    size_t textureBudget;
+    const char *tracePath;
+    const char *regressPath;
+    int regressUpdate;
+    int perfCounters;
+    const char *stepsOutput;
+    int frameHash;
+    const char *frameCachePath;
+    size_t frameCacheBudget;
+    sampler_type sampler;
+    int denoise;
+} render_settings_t;
+
+typedef struct {
+    render_settings_t *settings;
+    scene_t *scene;
+    texture_cache_t *textures;
+    video_writer_t *video;
+    checkpoint_t *checkpoint;
+    unsigned int settingsHash;
+    int resumeFrame;
+    pthread_mutex_t lock;
+    unsigned char *exported;
+    int exportedThrough;
+    ray_stats_t stats;
+    frame_cache_t *frameCache;
+    frame_cache_key_t renderKey;
+    denoise_t *denoiser;
+    unsigned char *cached;
+} sequence_t;
+
+typedef struct {
+    framebuffer_t *fb;
+    tile_grid_t *grid;
+    render_settings_t *settings;
+    scene_t *scene;
+    texture_cache_t *textures;
+    Vec3 camera;
+    int originY;
+    ray_stats_t *stats;
+} render_pass_t;
+
+typedef struct {
+    double frameTime;
+    double raysPerSecond;
+    double utilization;
+    double samplesPerPixel;
+    size_t memory;
+    float threads;
+    float samples;
+    float depth;
+    bool denoise;
+} overlay_t;
+
+int defaultScene(scene_t *scene) {
+    if (scene_create(scene, 4, 4, 3) != 0) return -1;
+    scene->camera = ORIGIN;
+    scene->viewport = (Vec3){VIEWPORT_WIDTH, VIEWPORT_HEIGHT, CAMERA_VIEWPORT_DISTANCE};
+    scene->background = DEFAULT_BACKGROUND;
+
+    scene->materials[0] = (material_t){.color = {1, 0, 0}, .specular = 500, .reflective = 0.2f, .texture = -1};
+    scene->materials[1] = (material_t){.color = {0, 0, 1}, .specular = 500, .reflective = 0.3f, .texture = -1};
+    scene->materials[2] = (material_t){.color = {0, 1, 0}, .specular = 10, .reflective = 0.4f, .texture = -1};
+    scene->materials[3] = (material_t){.color = {1, 1, 0}, .specular = 1000, .reflective = 0.5f, .texture = -1};
+    scene_set_sphere(scene, 0, (Vec3){0, -1, 3}, 1, 0);
+    scene_set_sphere(scene, 1, (Vec3){2, 0, 4}, 1, 1);
+    scene_set_sphere(scene, 2, (Vec3){-2, 0, 4}, 1, 2);
+    scene_set_sphere(scene, 3, (Vec3){0, -5001, 0}, 5000, 3);
+
+    scene->lights[0] = (light_t){LIGHT_AMBIENT, 0.2f, (Vec3){0, 0, 0}};
+    scene->lights[1] = (light_t){LIGHT_POINT, 0.6f, (Vec3){2, 1, 0}};
+    scene->lights[2] = (light_t){LIGHT_DIRECTIONAL, 0.2f, (Vec3){1, 4, 4}};
+    return 0;
+}
 
 void screenDrawPixel(int x, int y, Color c, Image *image) {
     int sX = (SCREEN_WIDTH / 2) + x;
@@ -24,48 +180,1531 @@ void screenDrawPixel(int x, int y, Color c, Image *image) {
     ImageDrawPixel(image, (int)x, (int)y, c);
 }
 
-Vec3 screenToViewPort(int sX, int sY) {
+Vec3 screenToViewPort(scene_t *scene, float sX, float sY, int width, int height) {
     return (Vec3){
-        (float)(sX*VIEWPORT_WIDTH/SCREEN_WIDTH), 
-        (float)(sY*VIEWPORT_HEIGHT/SCREEN_HEIGHT),
-        CAMERA_VIEWPORT_DISTANCE
+        sX*scene->viewport.x/width,
+        sY*scene->viewport.y/height,
+        scene->viewport.z
     };
 }
 
-void getRaySphereIntersection(Vec3 *origin, Vec3 *rayDir, sphere_t *sphere, int *t1, int *t2) {
-    float r = sphere->radius;
-    Vec3 centerToOrigin = sub(origin, &sphere->center);
+void getRaySphereIntersection(Vec3 *origin, Vec3 *rayDir, Vec3 *center, float r, float *t1, float *t2) {
+    Vec3 centerToOrigin = sub(origin, center);
 
     float a = dot(rayDir, rayDir);
     float b = 2*dot(&centerToOrigin, rayDir);
-    float c = dot(&centerToOrigin, &centerToOrigin);
+    float c = dot(&centerToOrigin, &centerToOrigin) - r*r;
 
     float discriminant = b*b - 4*a*c;
     if (discriminant < 0) {
         *t1 = T_MAX;
         *t2 = T_MAX;
+        return;
     }
 
     *t1 = (float)((-b + sqrt(discriminant)) / (2*a));
     *t2 = (float)((-b - sqrt(discriminant)) / (2*a));
 }
 
-Color3 traceRay(Vec3 origin, Vec3 rayDir, float tMin, float tMax) {
-    float closetT = T_MAX;
+int closestSphere(Vec3 *origin, Vec3 *rayDir, const float *x, const float *y, const float *z, const float *radius,
+                  int count, float tMin, float *closestT) {
+    int closest = -1;
+
+    for (int s = 0; s < count; s++) {
+        Vec3 center = {x[s], y[s], z[s]};
+        float t1, t2;
+        getRaySphereIntersection(origin, rayDir, &center, radius[s], &t1, &t2);
+        if (t1 >= tMin && t1 < *closestT) {
+            *closestT = t1;
+            closest = s;
+        }
+        if (t2 >= tMin && t2 < *closestT) {
+            *closestT = t2;
+            closest = s;
+        }
+    }
+    return closest;
+}
+
+int closestIntersection(scene_t *scene, Vec3 origin, Vec3 rayDir, float tMin, float tMax, float *closestT,
+                        sphere_hit_t *sphere, ray_stats_t *stats) {
+    PROFILE_COUNT(PROFILE_INTERSECT);
+    int found = 0;
+    int s;
+
+    *closestT = tMax < T_MAX ? nextafterf(tMax, T_MAX) : T_MAX;
+    s = closestSphere(&origin, &rayDir, scene->centerX, scene->centerY, scene->centerZ, scene->radius,
+                      scene->sphereCount, tMin, closestT);
+    stats->tests += scene->sphereCount;
+    if (s >= 0) {
+        *sphere = (sphere_hit_t){(Vec3){scene->centerX[s], scene->centerY[s], scene->centerZ[s]}, scene->material[s]};
+        found = 1;
+    }
+
+    if (scene->clusters != NULL) {
+        cluster_cache_t *cache = scene->clusters;
+        stats->nodes += cache->count;
+        for (int c = 0; c < cache->count; c++) {
+            if (!cluster_ray_hits(&cache->clusters[c], &origin, &rayDir, tMin, *closestT)) continue;
+
+            cluster_view_t view = cluster_acquire(cache, c);
+            s = closestSphere(&origin, &rayDir, view.x, view.y, view.z, view.radius, view.count, tMin, closestT);
+            stats->tests += view.count;
+            if (s >= 0) {
+                *sphere = (sphere_hit_t){(Vec3){view.x[s], view.y[s], view.z[s]}, view.material[s]};
+                found = 1;
+            }
+            cluster_release(cache, &view);
+        }
+    }
+    return found;
+}
+
+Vec3 reflectRay(Vec3 *rayDir, Vec3 *normal) {
+    Vec3 scaled = constant_multiply(normal, 2 * dot(normal, rayDir));
+    return sub(&scaled, rayDir);
+}
+
+float computeLighting(scene_t *scene, Vec3 *point, Vec3 *normal, Vec3 *view, float specular, ray_stats_t *stats) {
+    float intensity = 0;
+
+    for (int l = 0; l < scene->lightCount; l++) {
+        light_t *light = &scene->lights[l];
+        Vec3 toLight;
+        float tMax;
+        float shadowT;
+        sphere_hit_t blocker;
+
+        if (light->type == LIGHT_AMBIENT) {
+            intensity += light->intensity;
+            continue;
+        }
+        if (light->type == LIGHT_POINT) {
+            toLight = sub(&light->vector, point);
+            tMax = 1;
+        } else {
+            toLight = light->vector;
+            tMax = T_MAX;
+        }
+
+        stats->rays[RAY_SHADOW]++;
+        if (closestIntersection(scene, *point, toLight, SHADOW_EPSILON, tMax, &shadowT, &blocker, stats)) {
+            continue;
+        }
+
+        float nDotL = dot(normal, &toLight);
+        if (nDotL > 0) {
+            intensity += light->intensity * nDotL / (magnitude(normal) * magnitude(&toLight));
+        }
+        if (specular > 0) {
+            Vec3 reflected = reflectRay(&toLight, normal);
+            float rDotV = dot(&reflected, view);
+            if (rDotV > 0) {
+                intensity += light->intensity * powf(rDotV / (magnitude(&reflected) * magnitude(view)), specular);
+            }
+        }
+    }
+    return intensity;
+}
+
+/*
+ * Spheres are mapped by longitude and latitude. The ray cone's width at the
+ * hit, stretched by the incidence angle, sets the footprint that picks the
+ * mip level.
+ */
+Color3 surfaceColor(texture_cache_t *textures, material_t *material, Vec3 *normal, Vec3 *rayDir, float radius,
+                    float coneWidth) {
+    if (material->texture < 0) return material->color;
+
+    float u = 0.5f + atan2f(normal->z, normal->x) / (2 * PI);
+    float v = 0.5f - asinf(fmaxf(-1, fminf(1, normal->y))) / PI;
+    float incidence = fmaxf(fabsf(cos_angle(rayDir, normal)), 0.1f);
+    float footprint = coneWidth / incidence / (PI * radius);
+    Color3 texel = texture_sample(textures, material->texture, u, v, footprint / 2, footprint);
+    return (Color3){material->color.x * texel.x, material->color.y * texel.y, material->color.z * texel.z};
+}
+
+Color3 traceRay(scene_t *scene, texture_cache_t *textures, Vec3 origin, Vec3 rayDir, float tMin, float tMax, int depth,
+                ray_cone_t cone, hit_t *hit, ray_stats_t *stats) {
+    PROFILE_COUNT(PROFILE_SHADE);
+    float closestT;
+    sphere_hit_t sphere;
+
+    if (!closestIntersection(scene, origin, rayDir, tMin, tMax, &closestT, &sphere, stats)) {
+        if (hit != NULL) {
+            *hit = (hit_t){scene->background, (Vec3){0, 0, 0}, T_MAX};
+        }
+        return scene->background;
+    }
+    stats->hits++;
+    stats->depthSum += closestT;
+
+    material_t *material = &scene->materials[sphere.material];
+    ray r = {origin, rayDir, closestT};
+    Vec3 point = get_ray_vec3(&r);
+    Vec3 normal = sub(&point, &sphere.center);
+    Vec3 view = negate(&rayDir);
+
+    float radius = magnitude(&normal);
+    float coneWidth = cone.width + cone.spread * closestT * magnitude(&rayDir);
+
+    normal = constant_multiply(&normal, 1 / radius);
+    Color3 albedo = surfaceColor(textures, material, &normal, &rayDir, radius, coneWidth);
+    if (hit != NULL) {
+        hit->albedo = albedo;
+        hit->normal = normal;
+        hit->depth = closestT;
+    }
+
+    Color3 color = constant_multiply(&albedo, computeLighting(scene, &point, &normal, &view, material->specular, stats));
+    if (depth <= 0 || material->reflective <= 0) {
+        return color;
+    }
+
+    Vec3 reflectedDir = reflectRay(&view, &normal);
+    stats->rays[RAY_REFLECTION]++;
+    Color3 reflected = traceRay(scene, textures, point, reflectedDir, SHADOW_EPSILON, T_MAX, depth - 1,
+                                (ray_cone_t){coneWidth, cone.spread}, NULL, stats);
+    color = constant_multiply(&color, 1 - material->reflective);
+    reflected = constant_multiply(&reflected, material->reflective);
+    return add(&color, &reflected);
+}
+
+void mergeVec3(float *stored, Vec3 *sum, int samples, float weight) {
+    stored[0] += (sum->x / samples - stored[0]) * weight;
+    stored[1] += (sum->y / samples - stored[1]) * weight;
+    stored[2] += (sum->z / samples - stored[2]) * weight;
+}
+
+void renderTile(void *ctx, int index, int thread) {
+    render_pass_t *pass = (render_pass_t *)ctx;
+    framebuffer_t *fb = pass->fb;
+    render_settings_t *settings = pass->settings;
+    adaptive_settings_t *sampling = &pass->settings->sampling;
+    tile_t *tile = &pass->grid->tiles[index];
+    ray_stats_t *stats = &pass->stats[index];
+    float beauty[3 * ADAPTIVE_MAX_TILE_SIZE];
+    float albedo[3 * ADAPTIVE_MAX_TILE_SIZE];
+    float normal[3 * ADAPTIVE_MAX_TILE_SIZE];
+    float depth[ADAPTIVE_MAX_TILE_SIZE];
+    float variance[ADAPTIVE_MAX_TILE_SIZE];
+    ray_cone_t cone = {0, pass->scene->viewport.x / settings->width / pass->scene->viewport.z};
+    int active = 0;
+    float error = 0;
+
+    if (!tile->active) return;
+    PROFILE_ZONE("tile");
+    double tileStart = checkpoint_now();
+
+    for (int y = tile->y; y < tile->y + tile->height; y++) {
+        unsigned int *samples = fb->samples + (size_t)y * fb->width + tile->x;
+        float *cost = fb->cost + (size_t)y * fb->width + tile->x;
+        float *steps = fb->steps + (size_t)y * fb->width + tile->x;
+
+        fb_load_span(fb, FB_LAYER_BEAUTY, tile->x, y, tile->width, beauty);
+        fb_load_span(fb, FB_LAYER_ALBEDO, tile->x, y, tile->width, albedo);
+        fb_load_span(fb, FB_LAYER_NORMAL, tile->x, y, tile->width, normal);
+        fb_load_span(fb, FB_LAYER_DEPTH, tile->x, y, tile->width, depth);
+        fb_load_span(fb, FB_LAYER_VARIANCE, tile->x, y, tile->width, variance);
+
+        for (int i = 0; i < tile->width; i++) {
+            int x = tile->x + i;
+            float *color = &beauty[3*i];
+            float mean = luminance(color[0], color[1], color[2]);
+            int count = adaptive_samples_needed(sampling, mean, variance[i], samples[i]);
+            Color3 colorSum = {0, 0, 0};
+            Vec3 albedoSum = {0, 0, 0};
+            Vec3 normalSum = {0, 0, 0};
+            float depthSum = 0;
+            float batchMean = 0;
+            float batchM2 = 0;
+            double start = checkpoint_now();
+            unsigned long long visited = stats->nodes + stats->tests;
+
+            unsigned int pixel[RANDOM_PACKET];
+            unsigned int sample[RANDOM_PACKET];
+            float jitter[4][RANDOM_PACKET];
+
+            for (int l = 0; l < RANDOM_PACKET; l++) {
+                pixel[l] = (unsigned int)((size_t)(pass->originY + y) * fb->width + x);
+            }
+
+            for (int s = 0; s < count; s++) {
+                hit_t hit;
+                Vec3 rayDir;
+                {
+                    PROFILE_COUNT(PROFILE_RAYGEN);
+                    int lane = s % RANDOM_PACKET;
+                    if (settings->sampler != SAMPLER_RANDOM) {
+                        float offset[2];
+                        sampler_2d(settings->sampler, pixel[0], x, pass->originY + y, samples[i] + s, SAMPLER_CAMERA,
+                                   offset);
+                        jitter[0][lane] = offset[0];
+                        jitter[1][lane] = offset[1];
+                    } else if (lane == 0) {
+                        for (int l = 0; l < RANDOM_PACKET; l++) {
+                            sample[l] = samples[i] + s + l;
+                        }
+                        random_draw_packet(0, pixel, sample, 0, SAMPLER_CAMERA / 4, jitter);
+                    }
+                    float sX = x + jitter[0][lane] - settings->width / 2.0f;
+                    float sY = settings->height / 2.0f - (pass->originY + y + jitter[1][lane]);
+                    rayDir = screenToViewPort(pass->scene, sX, sY, settings->width, settings->height);
+                }
+                stats->rays[RAY_PRIMARY]++;
+                Color3 sample = traceRay(pass->scene, pass->textures, pass->camera, rayDir, 1, T_MAX, settings->maxDepth,
+                                         cone, &hit, stats);
+                float lum = luminance(sample.x, sample.y, sample.z);
+                float delta = lum - batchMean;
+
+                batchMean += delta / (s + 1);
+                batchM2 += delta * (lum - batchMean);
+                addEquals(&colorSum, &sample);
+                addEquals(&albedoSum, &hit.albedo);
+                addEquals(&normalSum, &hit.normal);
+                depthSum += hit.depth;
+            }
+            cost[i] += checkpoint_now() - start;
+            steps[i] += (float)(stats->nodes + stats->tests - visited);
+
+            if (count > 0) {
+                float weight = (float)count / (samples[i] + count);
+                adaptive_merge(&mean, &variance[i], samples[i], batchMean, batchM2, count);
+                mergeVec3(color, &colorSum, count, weight);
+                mergeVec3(&albedo[3*i], &albedoSum, count, weight);
+                mergeVec3(&normal[3*i], &normalSum, count, weight);
+                depth[i] += (depthSum / count - depth[i]) * weight;
+                samples[i] += count;
+            }
+
+            if (adaptive_samples_needed(sampling, mean, variance[i], samples[i]) > 0) {
+                active = 1;
+            }
+            error = fmaxf(error, adaptive_pixel_error(mean, variance[i], samples[i]));
+        }
+
+        fb_store_span(fb, FB_LAYER_BEAUTY, tile->x, y, tile->width, beauty);
+        fb_store_span(fb, FB_LAYER_ALBEDO, tile->x, y, tile->width, albedo);
+        fb_store_span(fb, FB_LAYER_NORMAL, tile->x, y, tile->width, normal);
+        fb_store_span(fb, FB_LAYER_DEPTH, tile->x, y, tile->width, depth);
+        fb_store_span(fb, FB_LAYER_VARIANCE, tile->x, y, tile->width, variance);
+    }
+
+    tile->active = active;
+    tile->error = error;
+    stats->busy += checkpoint_now() - tileStart;
+}
+
+Vec3 cameraPosition(scene_t *scene, int frame) {
+    float t = (float)frame / FPS;
+    return (Vec3){scene->camera.x + 0.5f * sinf(t), scene->camera.y, scene->camera.z};
+}
+
+int exportedThrough(sequence_t *sequence) {
+    int through;
+    pthread_mutex_lock(&sequence->lock);
+    through = sequence->exportedThrough;
+    pthread_mutex_unlock(&sequence->lock);
+    return through;
+}
+
+volatile sig_atomic_t memoryReportRequested = 0;
+
+void requestMemoryReport(int signum) {
+    memoryReportRequested = 1;
+}
+
+void reportMemory() {
+    memory_usage_t usage;
+
+    memory_usage(&usage);
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+        TraceLog(LOG_INFO, "Memory %-12s %10.1f KiB current, %10.1f KiB peak", memoryCategoryNames[c],
+                 usage.current[c] / 1024.0, usage.peak[c] / 1024.0);
+    }
+    TraceLog(LOG_INFO, "Memory %-12s %10.1f KiB current, %10.1f KiB peak", "total", usage.total / 1024.0,
+             usage.totalPeak / 1024.0);
+}
+
+/* Signal handlers only raise the flag; the report itself is written between passes. */
+void pollMemoryReport() {
+    if (memoryReportRequested) {
+        memoryReportRequested = 0;
+        reportMemory();
+    }
+}
+
+int renderRegion(framebuffer_t *fb, render_settings_t *settings, scene_t *scene, texture_cache_t *textures, Vec3 camera,
+                 int originY, int height, sequence_t *sequence, int frame, ray_stats_t *stats) {
+    tile_grid_t grid;
+    ray_stats_t *tileStats;
+    render_pass_t pass = {fb, &grid, settings, scene, textures, camera, originY, NULL};
+    checkpoint_t *checkpoint = sequence != NULL ? sequence->checkpoint : NULL;
+    int passes = 0;
+
+    if (tiles_create(&grid, fb->width, height, settings->tileSize) != 0) {
+        return -1;
+    }
+    tileStats = stats_create(grid.count);
+    if (tileStats == NULL) {
+        tiles_destroy(&grid);
+        return -1;
+    }
+    pass.stats = tileStats;
+
+    if (checkpoint != NULL && sequence->resumeFrame == frame) {
+        if (checkpoint_restore(checkpoint, fb, &grid) != 0) {
+            TraceLog(LOG_ERROR, "Checkpoint does not match the frame being rendered");
+            free(tileStats);
+            tiles_destroy(&grid);
+            return -1;
+        }
+        passes = checkpoint->header.passes;
+        sequence->resumeFrame = -1;
+        TraceLog(LOG_INFO, "Resumed frame %d at pass %d", frame, passes);
+    }
+
+    while (tiles_active(&grid) > 0) {
+        PROFILE_ZONE("pass");
+        parallel_for(grid.count, settings->threads, renderTile, &pass);
+        passes++;
+        pollMemoryReport();
+
+        if (checkpoint_due(checkpoint) && tiles_active(&grid) > 0) {
+            checkpoint_header_t header = {0};
+            header.settingsHash = sequence->settingsHash;
+            header.frame = frame;
+            header.passes = passes;
+            header.exportedThrough = exportedThrough(sequence);
+            if (checkpoint_save_async(checkpoint, fb, &grid, &header) != 0) {
+                TraceLog(LOG_WARNING, "Could not snapshot checkpoint");
+            }
+        }
+    }
+
+    TraceLog(LOG_DEBUG, "Rendered rows %d-%d in %d passes", originY, originY + height - 1, passes);
+    stats_merge(stats, tileStats, grid.count);
+    free(tileStats);
+    tiles_destroy(&grid);
+    return 0;
+}
+
+/*
+ * Replaces fb's beauty layer with its denoised version; the guide layers stay
+ * as rendered. The denoiser is shared by the whole sequence, and every
+ * pipeline framebuffer has the size it was created for.
+ */
+void denoiseBeauty(denoise_t *denoiser, framebuffer_t *fb) {
+    PROFILE_ZONE("denoise");
+    denoiser->fb = fb;
+    denoise_run(denoiser, NULL);
+}
+
+frame_cache_key_t frameKey(sequence_t *sequence, int frame) {
+    Vec3 camera = cameraPosition(sequence->scene, frame);
+    frame_cache_key_t key = sequence->renderKey;
+
+    frame_cache_key_add(&key, &camera, sizeof(camera));
+    return key;
+}
+
+int renderFrame(framebuffer_t *fb, sequence_t *sequence, int frame) {
+    PROFILE_ZONE("frame");
+    if (sequence->frameCache != NULL && frame_cache_load(sequence->frameCache, frameKey(sequence, frame), fb) == 0) {
+        sequence->cached[frame] = 1;
+        TraceLog(LOG_INFO, "Frame %d served from the frame cache", frame);
+        return 0;
+    }
+    int status = renderRegion(fb, sequence->settings, sequence->scene, sequence->textures,
+                              cameraPosition(sequence->scene, frame), 0, fb->height, sequence, frame, &sequence->stats);
+    if (status == 0 && sequence->denoiser != NULL) denoiseBeauty(sequence->denoiser, fb);
+    return status;
+}
+
+void reportRays(ray_stats_t *stats, int frame) {
+    unsigned long long rays = stats_rays(stats);
+
+    if (rays == 0) return;
+    TraceLog(LOG_INFO, "Frame %d rays: %llu primary, %llu shadow, %llu reflection; %.1f tests and %.2f nodes per ray, "
+             "average hit depth %.3f", frame, stats->rays[RAY_PRIMARY], stats->rays[RAY_SHADOW],
+             stats->rays[RAY_REFLECTION], (double)stats->tests / rays, (double)stats->nodes / rays,
+             stats->hits > 0 ? stats->depthSum / stats->hits : 0.0);
+}
+
+int renderStreaming(render_settings_t *settings, scene_t *scene, texture_cache_t *textures) {
+    framebuffer_t band;
+    stream_async_t stream;
+    ray_stats_t stats = {0};
+    int bandHeight = settings->tileSize;
+    int status = 0;
+    float *rgb;
+
+    if (fb_create(&band, settings->width, bandHeight, settings->bufferFormat) != 0) {
+        return -1;
+    }
+    rgb = malloc(sizeof(float) * 3 * settings->width * bandHeight);
+    if (rgb == NULL || stream_async_open(&stream, settings->output, settings->width, settings->height, STREAM_QUEUE_DEPTH) != 0) {
+        free(rgb);
+        fb_destroy(&band);
+        return -1;
+    }
+    memory_add(MEMORY_OUTPUT, sizeof(float) * 3 * settings->width * bandHeight);
+
+    for (int y = 0; y < settings->height && status == 0; y += bandHeight) {
+        int rows = settings->height - y < bandHeight ? settings->height - y : bandHeight;
+
+        fb_clear(&band);
+        status = renderRegion(&band, settings, scene, textures, cameraPosition(scene, 0), y, rows, NULL, 0, &stats);
+        for (int r = 0; r < rows && status == 0; r++) {
+            fb_load_row(&band, FB_LAYER_BEAUTY, r, rgb + (size_t)r * 3 * settings->width);
+        }
+        if (status == 0) {
+            status = stream_async_submit(&stream, rgb, rows);
+        }
+    }
+
+    if (stream_async_close(&stream) != 0) status = -1;
+    if (status == 0) reportRays(&stats, 0);
+    memory_add(MEMORY_OUTPUT, -(long long)(sizeof(float) * 3 * settings->width * bandHeight));
+    free(rgb);
+    fb_destroy(&band);
+    return status;
+}
+
+void resolvePixels(framebuffer_t *fb, Color *pixels) {
+    PROFILE_ZONE("resolve");
+    float *row = malloc(sizeof(float) * fb->width * 3);
+
+    if (row == NULL) return;
+    for (int y = 0; y < fb->height; y++) {
+        fb_load_row(fb, FB_LAYER_BEAUTY, y, row);
+        for (int x = 0; x < fb->width; x++) {
+            pixels[y * fb->width + x] = (Color){to_byte(row[3*x]), to_byte(row[3*x + 1]), to_byte(row[3*x + 2]), 255};
+        }
+    }
+    free(row);
+}
+
+/* 8 bit images handed to raylib for export or display, counted as output buffers. */
+Image outputImage(int width, int height, Color fill) {
+    Image image = GenImageColor(width, height, fill);
+    if (image.data != NULL) memory_add(MEMORY_OUTPUT, (long long)width * height * sizeof(Color));
+    return image;
+}
+
+void releaseOutputImage(Image image) {
+    if (image.data != NULL) memory_add(MEMORY_OUTPUT, -(long long)image.width * image.height * sizeof(Color));
+    UnloadImage(image);
+}
+
+Image resolveImage(framebuffer_t *fb) {
+    Image image = outputImage(fb->width, fb->height, (Color){255, 255, 255, 255});
+    resolvePixels(fb, (Color *)image.data);
+    return image;
+}
+
+Color falseColor(float t) {
+    float r, g, b;
+    if (t < 0) t = 0;
+    if (t > 1) t = 1;
+    r = fminf(fmaxf(4 * t - 2, 0), 1);
+    g = fminf(fmaxf(t < 0.5f ? 4 * t : 4 - 4 * t, 0), 1);
+    b = fminf(fmaxf(2 - 4 * t, 0), 1);
+    return (Color){to_byte(r), to_byte(g), to_byte(b), 255};
+}
+
+Image resolveSampleHeatmap(framebuffer_t *fb, int maxSamples) {
+    Image image = outputImage(fb->width, fb->height, (Color){0, 0, 0, 255});
+    Color *pixels = (Color *)image.data;
+
+    for (size_t p = 0; p < (size_t)fb->width * fb->height; p++) {
+        pixels[p] = falseColor((float)fb->samples[p] / maxSamples);
+    }
+    return image;
+}
+
+int compareFloats(const void *a, const void *b) {
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Per-pixel values scaled to the 99th percentile of the frame, so a few
+ * pixels that lost their core to the scheduler do not wash out the rest.
+ */
+Image resolveFalseColor(const float *values, int width, int height) {
+    Image image = outputImage(width, height, (Color){0, 0, 0, 255});
+    Color *pixels = (Color *)image.data;
+    size_t count = (size_t)width * height;
+    float *sorted = malloc(sizeof(float) * count);
+    float scale = 0;
+
+    if (sorted != NULL && count > 0) {
+        memcpy(sorted, values, sizeof(float) * count);
+        qsort(sorted, count, sizeof(float), compareFloats);
+        scale = sorted[count * 99 / 100];
+    }
+    free(sorted);
+    for (size_t p = 0; p < count; p++) {
+        pixels[p] = falseColor(scale > 0 ? values[p] / scale : 0);
+    }
+    return image;
+}
+
+/* Raw per-pixel values as a grey PFM, for scripts that want absolute numbers. */
+int writeGreyPfm(const float *values, int width, int height, const char *path) {
+    stream_writer_t writer;
+    float *row = malloc(sizeof(float) * 3 * width);
+    int status = 0;
+
+    if (row == NULL) return -1;
+    if (stream_open(&writer, path, width, height) != 0) {
+        if (writer.file != NULL) stream_close(&writer);
+        free(row);
+        return -1;
+    }
+    for (int y = 0; y < height && status == 0; y++) {
+        for (int x = 0; x < width; x++) {
+            row[3*x] = row[3*x + 1] = row[3*x + 2] = values[(size_t)y * width + x];
+        }
+        status = stream_write_rows(&writer, row, 1);
+    }
+    if (stream_close(&writer) != 0) status = -1;
+    free(row);
+    return status;
+}
+
+/* Box and sphere tests per sample, so adaptive sampling does not show up as traversal cost. */
+float *resolveSteps(framebuffer_t *fb) {
+    size_t count = (size_t)fb->width * fb->height;
+    float *steps = malloc(sizeof(float) * count);
+
+    if (steps == NULL) return NULL;
+    for (size_t p = 0; p < count; p++) {
+        steps[p] = fb->samples[p] > 0 ? fb->steps[p] / fb->samples[p] : 0;
+    }
+    return steps;
+}
+
+void framePath(char *path, const char *pattern, int frame, int frames) {
+    const char *extension = strrchr(pattern, '.');
+
+    if (frames <= 1) {
+        snprintf(path, MAX_PATH_LENGTH, "%s", pattern);
+    } else if (strchr(pattern, '%') != NULL) {
+        snprintf(path, MAX_PATH_LENGTH, pattern, frame);
+    } else if (extension != NULL) {
+        snprintf(path, MAX_PATH_LENGTH, "%.*s_%04d%s", (int)(extension - pattern), pattern, frame, extension);
+    } else {
+        snprintf(path, MAX_PATH_LENGTH, "%s_%04d", pattern, frame);
+    }
+}
+
+/* Writes a false color image to the pattern's path and the raw values next to it as .pfm. */
+int exportDiagnostic(const char *pattern, int frame, int frames, const float *values, int width, int height,
+                     const char *name) {
+    char path[MAX_PATH_LENGTH];
+    int status = 0;
+
+    framePath(path, pattern, frame, frames);
+    Image image = resolveFalseColor(values, width, height);
+    if (!ExportImage(image, path)) status = -1;
+    releaseOutputImage(image);
+
+    char *extension = strrchr(path, '.');
+    if (extension == NULL || strchr(extension, '/') != NULL) extension = path + strlen(path);
+    snprintf(extension, MAX_PATH_LENGTH - (extension - path), ".pfm");
+    if (writeGreyPfm(values, width, height, path) != 0) {
+        TraceLog(LOG_ERROR, "%s export to %s failed", name, path);
+        status = -1;
+    }
+    return status;
+}
+
+unsigned int settingsHash(render_settings_t *settings, scene_t *scene) {
+    int values[] = {
+        settings->width, settings->height, settings->tileSize, settings->bufferFormat, settings->frames,
+        settings->sampling.minSamples, settings->sampling.maxSamples, settings->sampling.samplesPerPass,
+        settings->maxDepth, settings->sampler, settings->denoise
+    };
+    unsigned int hash = checkpoint_hash(0, values, sizeof(values));
+    hash = checkpoint_hash(hash, &settings->sampling.threshold, sizeof(float));
+
+    hash = checkpoint_hash(hash, &scene->camera, sizeof(Vec3) * 3);
+    hash = checkpoint_hash(hash, scene->centerX, sizeof(float) * scene->sphereCount);
+    hash = checkpoint_hash(hash, scene->centerY, sizeof(float) * scene->sphereCount);
+    hash = checkpoint_hash(hash, scene->centerZ, sizeof(float) * scene->sphereCount);
+    hash = checkpoint_hash(hash, scene->radius, sizeof(float) * scene->sphereCount);
+    hash = checkpoint_hash(hash, scene->material, sizeof(unsigned int) * scene->sphereCount);
+    for (int m = 0; m < scene->materialCount; m++) {
+        material_t *material = &scene->materials[m];
+        hash = checkpoint_hash(hash, &material->color, sizeof(Color3));
+        hash = checkpoint_hash(hash, &material->specular, sizeof(float));
+        hash = checkpoint_hash(hash, &material->reflective, sizeof(float));
+        hash = checkpoint_hash(hash, material->texturePath, strlen(material->texturePath) + 1);
+    }
+    hash = checkpoint_hash(hash, scene->lights, sizeof(light_t) * scene->lightCount);
+    if (scene->clusters != NULL) {
+        hash = checkpoint_hash(hash, scene->clusters->clusters, sizeof(cluster_t) * scene->clusters->count);
+    }
+    return hash;
+}
+
+/*
+ * Frame cache key: everything that decides a frame's pixels except the camera
+ * position, which frameKey adds per frame. Textures and clustered sphere data
+ * live in their own files and are identified by size and modification time.
+ */
+frame_cache_key_t renderKey(render_settings_t *settings, scene_t *scene) {
+    int values[] = {
+        settings->width, settings->height, settings->tileSize, settings->bufferFormat,
+        settings->sampling.minSamples, settings->sampling.maxSamples, settings->sampling.samplesPerPass,
+        settings->maxDepth, settings->sampler, settings->denoise
+    };
+    frame_cache_key_t key = frame_cache_key();
+    struct stat info;
+
+    frame_cache_key_add(&key, values, sizeof(values));
+    frame_cache_key_add(&key, &settings->sampling.threshold, sizeof(float));
+    frame_cache_key_add(&key, &scene->camera, sizeof(Vec3) * 3);
+    frame_cache_key_add(&key, scene->centerX, sizeof(float) * scene->sphereCount);
+    frame_cache_key_add(&key, scene->centerY, sizeof(float) * scene->sphereCount);
+    frame_cache_key_add(&key, scene->centerZ, sizeof(float) * scene->sphereCount);
+    frame_cache_key_add(&key, scene->radius, sizeof(float) * scene->sphereCount);
+    frame_cache_key_add(&key, scene->material, sizeof(unsigned int) * scene->sphereCount);
+    frame_cache_key_add(&key, scene->lights, sizeof(light_t) * scene->lightCount);
+    for (int m = 0; m < scene->materialCount; m++) {
+        material_t *material = &scene->materials[m];
+        frame_cache_key_add(&key, &material->color, sizeof(Color3));
+        frame_cache_key_add(&key, &material->specular, sizeof(float));
+        frame_cache_key_add(&key, &material->reflective, sizeof(float));
+        frame_cache_key_add(&key, material->texturePath, strlen(material->texturePath) + 1);
+        if (material->texturePath[0] == '\0' || stat(material->texturePath, &info) != 0) continue;
+        frame_cache_key_add(&key, &info.st_size, sizeof(info.st_size));
+        frame_cache_key_add(&key, &info.st_mtim, sizeof(info.st_mtim));
+    }
+    if (scene->clusters != NULL) {
+        frame_cache_key_add(&key, scene->clusters->clusters, sizeof(cluster_t) * scene->clusters->count);
+        if (settings->scenePath != NULL && stat(settings->scenePath, &info) == 0) {
+            frame_cache_key_add(&key, &info.st_size, sizeof(info.st_size));
+            frame_cache_key_add(&key, &info.st_mtim, sizeof(info.st_mtim));
+        }
+    }
+    return key;
+}
+
+void markExported(sequence_t *sequence, int frame) {
+    pthread_mutex_lock(&sequence->lock);
+    sequence->exported[frame] = 1;
+    while (sequence->exportedThrough + 1 < sequence->settings->frames &&
+           sequence->exported[sequence->exportedThrough + 1]) {
+        sequence->exportedThrough++;
+    }
+    pthread_mutex_unlock(&sequence->lock);
+}
+
+void reportPerf(const char *stage, int frame, perf_sample_t *delta) {
+    static const char *names[PERF_EVENT_COUNT] = {NULL, NULL, "L1D", "LLC", "branch"};
+    double kiloInstructions = delta->value[PERF_INSTRUCTIONS] / 1000.0;
+    char text[256];
+    int length;
+
+    length = snprintf(text, sizeof(text), "Frame %d %s: %.3f Gcycles, IPC %.2f", frame, stage,
+                      delta->value[PERF_CYCLES] / 1e9,
+                      delta->value[PERF_CYCLES] > 0 ? (double)delta->value[PERF_INSTRUCTIONS] / delta->value[PERF_CYCLES] : 0.0);
+    for (int e = PERF_L1D_MISSES; e < PERF_EVENT_COUNT && length < (int)sizeof(text); e++) {
+        if (delta->valid[e]) {
+            length += snprintf(text + length, sizeof(text) - length, ", %s %.2f MPKI", names[e],
+                               kiloInstructions > 0 ? delta->value[e] / kiloInstructions : 0.0);
+        } else {
+            length += snprintf(text + length, sizeof(text) - length, ", %s n/a", names[e]);
+        }
+    }
+    TraceLog(LOG_INFO, "%s", text);
+}
+
+int exportFrame(void *ctx, framebuffer_t *fb, int frame) {
+    sequence_t *context = (sequence_t *)ctx;
+    render_settings_t *settings = context->settings;
+    char path[MAX_PATH_LENGTH];
+    int status = 0;
+    perf_counters_t perf;
+    perf_sample_t before, resolved, written;
+    int counting = settings->perfCounters && perf_open(&perf, 0) == 0;
+    PROFILE_ZONE("export");
+
+    if (settings->frameHash) {
+        TraceLog(LOG_INFO, "Frame %d hash %016llx", frame, fb_hash(fb));
+    }
+    if (counting) perf_read(&perf, &before);
+    Image image = resolveImage(fb);
+    if (counting) perf_read(&perf, &resolved);
+    if (context->video != NULL && video_write_frame(context->video, frame, (unsigned char *)image.data) != 0) {
+        status = -1;
+    }
+    if (settings->output != NULL) {
+        framePath(path, settings->output, frame, settings->frames);
+        if (!ExportImage(image, path)) status = -1;
+    }
+    releaseOutputImage(image);
+
+    if (settings->heatmap != NULL) {
+        framePath(path, settings->heatmap, frame, settings->frames);
+        Image heatmap = resolveSampleHeatmap(fb, settings->sampling.maxSamples);
+        if (!ExportImage(heatmap, path)) status = -1;
+        releaseOutputImage(heatmap);
+    }
+
+    if (settings->costOutput != NULL &&
+        exportDiagnostic(settings->costOutput, frame, settings->frames, fb->cost, fb->width, fb->height, "Cost") != 0) {
+        status = -1;
+    }
+
+    if (settings->stepsOutput != NULL) {
+        float *steps = resolveSteps(fb);
+        if (steps == NULL ||
+            exportDiagnostic(settings->stepsOutput, frame, settings->frames, steps, fb->width, fb->height, "Steps") != 0) {
+            status = -1;
+        }
+        free(steps);
+    }
+
+    if (settings->hdrOutput != NULL) {
+        framePath(path, settings->hdrOutput, frame, settings->frames);
+        if (hdr_write(fb, path, settings->hdrCompression) != 0) {
+            TraceLog(LOG_ERROR, "HDR export to %s failed", path);
+            status = -1;
+        }
+    }
+    if (counting) {
+        perf_read(&perf, &written);
+        perf_close(&perf);
+        perf_sample_t delta = perf_delta(&before, &resolved);
+        reportPerf("resolve", frame, &delta);
+        delta = perf_delta(&resolved, &written);
+        reportPerf("export", frame, &delta);
+    }
+    if (context->frameCache != NULL && !context->cached[frame] &&
+        frame_cache_store(context->frameCache, frameKey(context, frame), fb) != 0) {
+        TraceLog(LOG_WARNING, "Could not add frame %d to the frame cache", frame);
+    }
+    if (status == 0) markExported(context, frame);
+    return status;
+}
+
+void resumeSequence(sequence_t *sequence, int *startFrame) {
+    checkpoint_header_t *header = &sequence->checkpoint->header;
+
+    if (checkpoint_load(sequence->checkpoint, sequence->settingsHash) != 0) {
+        TraceLog(LOG_WARNING, "No usable checkpoint at %s, starting from the beginning", sequence->checkpoint->path);
+        return;
+    }
+    for (int frame = 0; frame <= header->exportedThrough; frame++) {
+        sequence->exported[frame] = 1;
+    }
+    sequence->exportedThrough = header->exportedThrough;
+    sequence->resumeFrame = header->frame;
+    *startFrame = header->exportedThrough + 1;
+    TraceLog(LOG_INFO, "Resuming: frames up to %d exported, frame %d at pass %d",
+             header->exportedThrough, header->frame, header->passes);
+}
+
+void reportTextures(texture_cache_t *textures, int frame) {
+    texture_stats_t stats = texture_take_stats(textures);
+    TraceLog(LOG_INFO, "Frame %d textures: %llu tile lookups, %llu tile misses, %llu evictions", frame, stats.lookups,
+             stats.misses, stats.evictions);
+}
+
+void bindTextures(texture_cache_t *textures, scene_t *scene) {
+    for (int m = 0; m < scene->materialCount; m++) {
+        material_t *material = &scene->materials[m];
+        if (material->texturePath[0] == '\0') continue;
+        material->texture = texture_cache_add(textures, material->texturePath);
+        if (material->texture < 0) {
+            TraceLog(LOG_WARNING, "Could not load texture %s, using the flat material color", material->texturePath);
+        }
+    }
+}
+
+void reportAcceleration(scene_t *scene) {
+    accel_metrics_t metrics;
+    char histogram[ACCEL_HISTOGRAM_BINS * 32] = "";
+    int length = 0;
+
+    if (scene->clusters == NULL) {
+        TraceLog(LOG_INFO, "Acceleration: none, every ray tests all %d spheres", scene->sphereCount);
+        return;
+    }
+    accel_measure(&metrics, scene->sphereCount, scene->clusters->clusters, scene->clusters->count);
+    TraceLog(LOG_INFO, "Acceleration: SAH cost %.1f tests per ray, %d leaves, %.3f entered and %.3f overlapping per ray",
+             metrics.sah, metrics.leaves, metrics.leafHits, metrics.overlap);
+    for (int b = 0; b < ACCEL_HISTOGRAM_BINS; b++) {
+        if (metrics.histogram[b] == 0) continue;
+        length += snprintf(histogram + length, sizeof(histogram) - length, " %u-%u:%d", b > 0 ? 1u << (b - 1) : 0,
+                           b > 0 ? (1u << b) - 1 : 0, metrics.histogram[b]);
+    }
+    TraceLog(LOG_INFO, "Leaf sizes %u to %u, mean %.1f;%s", metrics.leafMin, metrics.leafMax,
+             metrics.leaves > 0 ? (double)metrics.leafSpheres / metrics.leaves : 0.0, histogram);
+}
+
+void reportClusters(cluster_cache_t *cache, int frame) {
+    cluster_stats_t stats = cluster_take_stats(cache);
+    size_t bytes;
+    int resident = cluster_resident(cache, &bytes);
+
+    TraceLog(LOG_INFO, "Frame %d clusters: %llu loads, %llu evictions, %llu waits, %d/%d resident (%zu KiB)",
+             frame, stats.loads, stats.evictions, stats.waits, resident, cache->count, bytes / 1024);
+    if (stats.failures > 0) {
+        TraceLog(LOG_WARNING, "Frame %d: %llu attempts to map cluster chunks failed, those rays missed their spheres",
+                 frame, stats.failures);
+    }
+}
+
+int renderSequence(render_settings_t *settings, scene_t *scene, texture_cache_t *textures) {
+    pipeline_t pipeline;
+    video_writer_t video;
+    checkpoint_t checkpoint;
+    frame_cache_t frameCache;
+    denoise_t denoiser;
+    sequence_t sequence = {.settings = settings, .scene = scene, .textures = textures,
+                           .settingsHash = settingsHash(settings, scene), .resumeFrame = -1};
+    perf_counters_t perf;
+    perf_sample_t before, after;
+    int counting = 0;
+    int startFrame = 0;
+    int status = 0;
+
+    sequence.exported = calloc(settings->frames, 1);
+    sequence.cached = calloc(settings->frames, 1);
+    sequence.exportedThrough = -1;
+    if (sequence.exported == NULL || sequence.cached == NULL) {
+        free(sequence.exported);
+        free(sequence.cached);
+        return -1;
+    }
+    pthread_mutex_init(&sequence.lock, NULL);
+
+    if (settings->frameCachePath != NULL) {
+        if (frame_cache_open(&frameCache, settings->frameCachePath, settings->frameCacheBudget) == 0) {
+            sequence.frameCache = &frameCache;
+            sequence.renderKey = renderKey(settings, scene);
+        } else {
+            TraceLog(LOG_WARNING, "Could not open frame cache %s, rendering every frame", settings->frameCachePath);
+        }
+    }
+
+    if (settings->checkpointPath != NULL) {
+        if (checkpoint_init(&checkpoint, settings->checkpointPath, settings->checkpointInterval) == 0) {
+            sequence.checkpoint = &checkpoint;
+            if (settings->resume) resumeSequence(&sequence, &startFrame);
+        } else {
+            TraceLog(LOG_WARNING, "Checkpointing disabled");
+        }
+    }
+
+    if (settings->videoOutput != NULL && startFrame > 0) {
+        if (video_resume(&video, settings->videoOutput, settings->videoFormat, settings->width, settings->height, FPS,
+                         startFrame) != 0) {
+            TraceLog(LOG_ERROR, "Could not resume video output %s: it must be a file holding the %d frames already exported",
+                     settings->videoOutput, startFrame);
+            status = -1;
+            goto done;
+        }
+        sequence.video = &video;
+    } else if (settings->videoOutput != NULL) {
+        if (video_open(&video, settings->videoOutput, settings->videoFormat, settings->width, settings->height, FPS) != 0) {
+            TraceLog(LOG_ERROR, "Could not open video output %s", settings->videoOutput);
+            status = -1;
+            goto done;
+        }
+        sequence.video = &video;
+    }
+
+    if (pipeline_create(&pipeline, settings->width, settings->height, settings->bufferFormat,
+                        settings->ioThreads, settings->exportDepth, exportFrame, &sequence) != 0) {
+        TraceLog(LOG_ERROR, "Could not allocate %d %dx%d framebuffers", settings->ioThreads + settings->exportDepth,
+                 settings->width, settings->height);
+        status = -1;
+        goto done;
+    }
+    TraceLog(LOG_INFO, "Framebuffers: %d x %dx%d, %s, %zu bytes each", pipeline.slotCount, settings->width,
+             settings->height, settings->bufferFormat == FB_FLOAT16 ? "half" : "float", fb_bytes(&pipeline.slots[0].fb));
+
+    if (settings->denoise) {
+        if (denoise_create(&denoiser, &pipeline.slots[0].fb, settings->threads) == 0) {
+            sequence.denoiser = &denoiser;
+        } else {
+            TraceLog(LOG_WARNING, "Could not allocate the denoiser, exporting frames as rendered");
+        }
+    }
+
+    /* Opened after the export threads exist, so the render counters only see the render threads. */
+    if (settings->perfCounters) {
+        counting = perf_open(&perf, 1) == 0;
+        if (!counting) {
+            TraceLog(LOG_WARNING, "Hardware counters unavailable, check perf_event_paranoid; rendering without them");
+            settings->perfCounters = 0;
+        }
+    }
+
+    for (int frame = startFrame; frame < settings->frames && status == 0; frame++) {
+        pipeline_slot_t *slot = pipeline_acquire(&pipeline);
+
+        fb_clear(&slot->fb);
+        stats_reset(&sequence.stats, 1);
+        if (counting) perf_read(&perf, &before);
+        if (renderFrame(&slot->fb, &sequence, frame) != 0) {
+            TraceLog(LOG_ERROR, "Could not render frame %d", frame);
+            status = -1;
+        }
+        if (counting) {
+            perf_read(&perf, &after);
+            perf_sample_t delta = perf_delta(&before, &after);
+            reportPerf("render", frame, &delta);
+        }
+        reportRays(&sequence.stats, frame);
+        if (scene->clusters != NULL) reportClusters(scene->clusters, frame);
+        if (textures->count > 0) reportTextures(textures, frame);
+        pipeline_submit(&pipeline, slot, frame);
+    }
+
+    if (pipeline_destroy(&pipeline) != 0) {
+        TraceLog(LOG_ERROR, "Some frames failed to export");
+        status = -1;
+    }
+    if (counting) perf_close(&perf);
+    if (sequence.denoiser != NULL) denoise_destroy(&denoiser);
+
+done:
+    if (sequence.video != NULL && video_close(&video) != 0) {
+        TraceLog(LOG_ERROR, "Video output %s failed", settings->videoOutput);
+        status = -1;
+    }
+    if (sequence.checkpoint != NULL) {
+        checkpoint_destroy(&checkpoint, status == 0);
+    }
+    if (sequence.frameCache != NULL) {
+        TraceLog(LOG_INFO, "Frame cache: %llu hits, %llu misses, %llu stored, %llu evicted", frameCache.hits,
+                 frameCache.misses, frameCache.stores, frameCache.evictions);
+        frame_cache_close(&frameCache);
+    }
+    pthread_mutex_destroy(&sequence.lock);
+    free(sequence.exported);
+    free(sequence.cached);
+    return status;
+}
+
+void reloadScene(scene_t *scene, scene_t *staging, const char *path, framebuffer_t *fb, tile_grid_t *grid,
+                 render_pass_t *pass) {
+    int changed = scene_reload(scene, staging, path, pass->settings->clusterBudget);
+
+    if (changed < 0) {
+        TraceLog(LOG_WARNING, "Keeping the previous scene, %s could not be loaded", path);
+        return;
+    }
+    if (changed == 0) return;
+
+    bindTextures(pass->textures, scene);
+    fb_clear(fb);
+    tiles_reset(grid);
+    pass->camera = cameraPosition(scene, 0);
+    TraceLog(LOG_INFO, "Reloaded %s: %d changes, %d spheres", path, changed, scene->sphereCount);
+}
+
+void measurePass(overlay_t *overlay, framebuffer_t *fb, ray_stats_t *passStats, double elapsed, int workers) {
+    unsigned long long samples = 0;
+
+    for (size_t p = 0; p < (size_t)fb->width * fb->height; p++) {
+        samples += fb->samples[p];
+    }
+    overlay->frameTime = elapsed;
+    overlay->raysPerSecond = elapsed > 0 ? stats_rays(passStats) / elapsed : 0;
+    overlay->utilization = elapsed > 0 ? passStats->busy / (elapsed * workers) : 0;
+    overlay->samplesPerPixel = (double)samples / ((size_t)fb->width * fb->height);
+}
+
+void drawOverlay(overlay_t *overlay, int maxThreads) {
+    char text[64];
+    float y = 40;
+
+    GuiPanel((Rectangle){10, 10, 260, 222}, "Performance");
+    snprintf(text, sizeof(text), "Frame time: %.1f ms", overlay->frameTime * 1000);
+    GuiLabel((Rectangle){20, y, 240, 16}, text);
+    snprintf(text, sizeof(text), "Throughput: %.2f Mrays/s", overlay->raysPerSecond / 1e6);
+    GuiLabel((Rectangle){20, y += 18, 240, 16}, text);
+    snprintf(text, sizeof(text), "Samples per pixel: %.1f", overlay->samplesPerPixel);
+    GuiLabel((Rectangle){20, y += 18, 240, 16}, text);
+    snprintf(text, sizeof(text), "Thread utilization: %.0f%%", overlay->utilization * 100);
+    GuiLabel((Rectangle){20, y += 18, 240, 16}, text);
+    snprintf(text, sizeof(text), "Memory: %.1f MiB", overlay->memory / 1048576.0);
+    GuiLabel((Rectangle){20, y += 18, 240, 16}, text);
+
+    snprintf(text, sizeof(text), "%d", (int)lroundf(overlay->threads));
+    GuiSliderBar((Rectangle){80, y += 26, 150, 16}, "Threads", text, &overlay->threads, 1, maxThreads);
+    snprintf(text, sizeof(text), "%d", (int)lroundf(overlay->samples));
+    GuiSliderBar((Rectangle){80, y += 22, 150, 16}, "Samples", text, &overlay->samples, 1, OVERLAY_MAX_SAMPLES);
+    snprintf(text, sizeof(text), "%d", (int)lroundf(overlay->depth));
+    GuiSliderBar((Rectangle){80, y += 22, 150, 16}, "Bounces", text, &overlay->depth, 0, OVERLAY_MAX_DEPTH);
+    GuiCheckBox((Rectangle){80, y += 22, 16, 16}, "Denoise", &overlay->denoise);
+}
+
+/* Slider changes apply between frames. A new bounce depth changes the image, more samples only refine it. */
+void applyOverlay(overlay_t *overlay, render_settings_t *settings, framebuffer_t *fb, tile_grid_t *grid,
+                  ray_stats_t *stats) {
+    int threads = (int)lroundf(overlay->threads);
+    int samples = (int)lroundf(overlay->samples);
+    int depth = (int)lroundf(overlay->depth);
+
+    settings->threads = threads;
+    if (samples != settings->sampling.maxSamples) {
+        if (samples > settings->sampling.maxSamples) tiles_activate(grid);
+        settings->sampling.maxSamples = samples;
+    }
+    if (depth != settings->maxDepth) {
+        settings->maxDepth = depth;
+        fb_clear(fb);
+        tiles_reset(grid);
+        stats_reset(stats, 1);
+    }
+}
+
+/*
+ * The window shows the beauty layer or, with the denoise box ticked, a
+ * filtered copy of it; accumulation always continues on the raw samples. The
+ * denoiser's planes are allocated the first time the box is ticked.
+ */
+void resolvePreview(framebuffer_t *fb, denoise_t *denoiser, float *rgb, Color *pixels) {
+    if (denoiser == NULL) {
+        resolvePixels(fb, pixels);
+        return;
+    }
+    PROFILE_ZONE("denoise");
+    denoise_run(denoiser, rgb);
+    for (size_t p = 0; p < (size_t)fb->width * fb->height; p++) {
+        pixels[p] = (Color){to_byte(rgb[3*p]), to_byte(rgb[3*p + 1]), to_byte(rgb[3*p + 2]), 255};
+    }
 }
 
+int renderInteractive(render_settings_t *settings, scene_t *scene, texture_cache_t *textures) {
+    framebuffer_t fb;
+    tile_grid_t grid;
+    scene_t staging = {0};
+    watch_t watch;
+    int watching = 0;
+    ray_stats_t *tileStats;
+    denoise_t denoiser = {0};
+    float *denoised = NULL;
+    size_t denoisedBytes = sizeof(float) * 3 * settings->width * settings->height;
+
+    if (fb_create(&fb, settings->width, settings->height, settings->bufferFormat) != 0) {
+        return -1;
+    }
+
+    if (tiles_create(&grid, settings->width, settings->height, settings->tileSize) != 0) {
+        fb_destroy(&fb);
+        return -1;
+    }
+    tileStats = stats_create(grid.count);
+    if (tileStats == NULL) {
+        tiles_destroy(&grid);
+        fb_destroy(&fb);
+        return -1;
+    }
+    if (settings->scenePath != NULL) {
+        watching = watch_init(&watch, settings->scenePath) == 0;
+        if (!watching) TraceLog(LOG_WARNING, "Not watching %s for changes", settings->scenePath);
+    }
+
+    ray_stats_t stats = {0};
+    int converged = 0;
+    int maxThreads = 2 * parallel_default_threads();
+    overlay_t overlay = {0};
+    render_pass_t pass = {&fb, &grid, settings, scene, textures, cameraPosition(scene, 0), 0, tileStats};
+
+    if (maxThreads > PARALLEL_MAX_THREADS) maxThreads = PARALLEL_MAX_THREADS;
+    if (settings->threads > maxThreads) settings->threads = maxThreads;
+    if (settings->sampling.maxSamples > OVERLAY_MAX_SAMPLES) settings->sampling.maxSamples = OVERLAY_MAX_SAMPLES;
+    if (settings->maxDepth > OVERLAY_MAX_DEPTH) settings->maxDepth = OVERLAY_MAX_DEPTH;
+    overlay.threads = settings->threads;
+    overlay.samples = settings->sampling.maxSamples;
+    overlay.depth = settings->maxDepth;
+    overlay.denoise = settings->denoise;
+    int shown = -1;
 
-int main() {
-    InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "ez_raytracer");
+    InitWindow(settings->width, settings->height, "ez_raytracer");
     SetTargetFPS(FPS);
+    Image image = outputImage(settings->width, settings->height, (Color){255, 255, 255, 255});
+    Texture2D texture = LoadTextureFromImage(image);
 
-    Image i = GenImageColor(640, 400, (Color){255,255,255,255});
-    for (int c = 0; c < SCREEN_WIDTH; c++) {
-        ImageDrawPixel(&i, c, 10, (Color){0, 0, 255, 255});
+    while (!WindowShouldClose()) {
+        if (watching && watch_changed(&watch)) {
+            reloadScene(scene, &staging, settings->scenePath, &fb, &grid, &pass);
+            stats_reset(&stats, 1);
+        }
+        if (tiles_active(&grid) > 0) {
+            ray_stats_t passStats = {0};
+            double start = checkpoint_now();
+
+            stats_reset(tileStats, grid.count);
+            parallel_for(grid.count, settings->threads, renderTile, &pass);
+            stats_merge(&passStats, tileStats, grid.count);
+            stats_merge(&stats, &passStats, 1);
+            measurePass(&overlay, &fb, &passStats, checkpoint_now() - start,
+                        settings->threads < grid.count ? settings->threads : grid.count);
+            shown = -1;
+            if (tiles_active(&grid) == 0) {
+                reportRays(&stats, converged++);
+                stats_reset(&stats, 1);
+            }
+        }
+        if (overlay.denoise && denoised == NULL) {
+            denoised = malloc(denoisedBytes);
+            if (denoised == NULL || denoise_create(&denoiser, &fb, maxThreads) != 0) {
+                TraceLog(LOG_WARNING, "Could not allocate the denoiser, showing the raw preview");
+                free(denoised);
+                denoised = NULL;
+                overlay.denoise = false;
+            } else {
+                memory_add(MEMORY_OUTPUT, denoisedBytes);
+            }
+        }
+        if (shown != overlay.denoise) {
+            denoiser.threads = settings->threads;
+            resolvePreview(&fb, overlay.denoise ? &denoiser : NULL, denoised, (Color *)image.data);
+            UpdateTexture(texture, image.data);
+            shown = overlay.denoise;
+        }
+
+        overlay.memory = memory_total();
+        pollMemoryReport();
+
+        BeginDrawing();
+        DrawTexture(texture, 0, 0, WHITE);
+        drawOverlay(&overlay, maxThreads);
+        EndDrawing();
+        applyOverlay(&overlay, settings, &fb, &grid, &stats);
     }
-    ExportImage(i, "o.png");
-    Vec3
 
-    //CloseWindow();
+    UnloadTexture(texture);
+    releaseOutputImage(image);
+    CloseWindow();
+    if (watching) watch_destroy(&watch);
+    scene_destroy(&staging);
+    if (denoised != NULL) {
+        memory_add(MEMORY_OUTPUT, -(long long)denoisedBytes);
+        free(denoised);
+        denoise_destroy(&denoiser);
+    }
+    free(tileStats);
+    tiles_destroy(&grid);
+    fb_destroy(&fb);
     return 0;
 }
+
+int compareGolden(regress_entry_t *entry, Image image, double elapsed) {
+    Image golden = LoadImage(entry->golden);
+    int passed;
+
+    if (golden.data == NULL) {
+        TraceLog(LOG_ERROR, "FAIL %s: no golden image, create it with --regress-update", entry->golden);
+        return -1;
+    }
+    if (golden.width != image.width || golden.height != image.height) {
+        TraceLog(LOG_ERROR, "FAIL %s: golden image is %dx%d, render is %dx%d", entry->golden, golden.width,
+                 golden.height, image.width, image.height);
+        UnloadImage(golden);
+        return -1;
+    }
+
+    Color *expected = LoadImageColors(golden);
+    double rmse = regress_rmse(expected, (Color *)image.data, (size_t)image.width * image.height);
+    double ssim = regress_ssim(expected, (Color *)image.data, image.width, image.height);
+    UnloadImageColors(expected);
+    UnloadImage(golden);
+
+    passed = rmse <= entry->maxRmse && ssim >= entry->minSsim && (entry->budget <= 0 || elapsed <= entry->budget);
+    TraceLog(passed ? LOG_INFO : LOG_ERROR, "%s %s: rmse %.5f (max %.5f), ssim %.4f (min %.4f), %.3fs (budget %.3fs)",
+             passed ? "PASS" : "FAIL", entry->golden, rmse, entry->maxRmse, ssim, entry->minSsim, elapsed, entry->budget);
+    return passed ? 0 : -1;
+}
+
+int regressEntry(render_settings_t *settings, regress_entry_t *entry) {
+    texture_cache_t textures;
+    framebuffer_t fb;
+    scene_t scene;
+    ray_stats_t stats = {0};
+    int builtIn = strcmp(entry->scene, "-") == 0;
+    int status;
+
+    if (builtIn ? defaultScene(&scene) != 0 : scene_load(&scene, entry->scene, settings->clusterBudget) != 0) {
+        TraceLog(LOG_ERROR, "FAIL %s: could not load scene %s", entry->golden, entry->scene);
+        return -1;
+    }
+    if (texture_cache_create(&textures, settings->textureBudget) != 0) {
+        scene_destroy(&scene);
+        return -1;
+    }
+    if (fb_create(&fb, settings->width, settings->height, settings->bufferFormat) != 0) {
+        texture_cache_destroy(&textures);
+        scene_destroy(&scene);
+        return -1;
+    }
+    bindTextures(&textures, &scene);
+
+    double start = checkpoint_now();
+    status = renderRegion(&fb, settings, &scene, &textures, cameraPosition(&scene, 0), 0, fb.height, NULL, 0, &stats);
+    double elapsed = checkpoint_now() - start;
+
+    if (status == 0) {
+        Image image = resolveImage(&fb);
+        if (settings->regressUpdate) {
+            status = ExportImage(image, entry->golden) ? 0 : -1;
+            TraceLog(status == 0 ? LOG_INFO : LOG_ERROR, "%s golden image %s (%.2fs)",
+                     status == 0 ? "Wrote" : "Could not write", entry->golden, elapsed);
+        } else {
+            status = compareGolden(entry, image, elapsed);
+        }
+        releaseOutputImage(image);
+    }
+
+    fb_destroy(&fb);
+    texture_cache_destroy(&textures);
+    scene_destroy(&scene);
+    return status;
+}
+
+/*
+ * Renders every manifest entry with the command line settings and compares it
+ * to its golden image. Render times are wall clock, so budgets need headroom
+ * for the machine they run on.
+ */
+int runRegression(render_settings_t *settings) {
+    FILE *manifest = fopen(settings->regressPath, "r");
+    char line[3 * REGRESS_PATH_LENGTH];
+    int lineNumber = 0;
+    int passed = 0;
+    int failed = 0;
+
+    if (manifest == NULL) {
+        TraceLog(LOG_ERROR, "Could not open regression manifest %s", settings->regressPath);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), manifest) != NULL) {
+        regress_entry_t entry;
+        int parsed = regress_parse_line(line, settings->regressPath, &entry);
+
+        lineNumber++;
+        if (parsed == 0) continue;
+        if (parsed < 0) {
+            TraceLog(LOG_ERROR, "%s:%d: expected scene, golden image, max rmse, min ssim and budget",
+                     settings->regressPath, lineNumber);
+            failed++;
+            continue;
+        }
+        if (regressEntry(settings, &entry) == 0) {
+            passed++;
+        } else {
+            failed++;
+        }
+    }
+    fclose(manifest);
+
+    TraceLog(failed > 0 ? LOG_ERROR : LOG_INFO, "Regression: %d passed, %d failed", passed, failed);
+    return failed > 0 ? -1 : 0;
+}
+
+void traceToStderr(int logLevel, const char *text, va_list args) {
+    vfprintf(stderr, text, args);
+    fputc('\n', stderr);
+}
+
+void parseArgs(int argc, char **argv, render_settings_t *settings) {
+    const char *output = NULL;
+
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "--half") == 0) {
+            settings->bufferFormat = FB_FLOAT16;
+        } else if (strcmp(argv[a], "--width") == 0 && a + 1 < argc) {
+            settings->width = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--height") == 0 && a + 1 < argc) {
+            settings->height = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--threads") == 0 && a + 1 < argc) {
+            settings->threads = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--tile-size") == 0 && a + 1 < argc) {
+            settings->tileSize = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--min-spp") == 0 && a + 1 < argc) {
+            settings->sampling.minSamples = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--spp") == 0 && a + 1 < argc) {
+            settings->sampling.maxSamples = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--pass-spp") == 0 && a + 1 < argc) {
+            settings->sampling.samplesPerPass = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--threshold") == 0 && a + 1 < argc) {
+            settings->sampling.threshold = atof(argv[++a]);
+        } else if (strcmp(argv[a], "--hdr") == 0 && a + 1 < argc) {
+            settings->hdrOutput = argv[++a];
+        } else if (strcmp(argv[a], "--exr-compression") == 0 && a + 1 < argc) {
+            a++;
+            settings->hdrCompression = strcmp(argv[a], "none") == 0 ? EXR_COMPRESSION_NONE : EXR_COMPRESSION_ZIP;
+        } else if (strcmp(argv[a], "--frames") == 0 && a + 1 < argc) {
+            settings->frames = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--io-threads") == 0 && a + 1 < argc) {
+            settings->ioThreads = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--export-queue") == 0 && a + 1 < argc) {
+            settings->exportDepth = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--checkpoint") == 0 && a + 1 < argc) {
+            settings->checkpointPath = argv[++a];
+        } else if (strcmp(argv[a], "--checkpoint-interval") == 0 && a + 1 < argc) {
+            settings->checkpointInterval = atof(argv[++a]);
+        } else if (strcmp(argv[a], "--resume") == 0) {
+            settings->resume = 1;
+        } else if (strcmp(argv[a], "--depth") == 0 && a + 1 < argc) {
+            settings->maxDepth = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "--scene") == 0 && a + 1 < argc) {
+            settings->scenePath = argv[++a];
+        } else if (strcmp(argv[a], "--cluster-budget") == 0 && a + 1 < argc) {
+            settings->clusterBudget = (size_t)atol(argv[++a]) << 20;
+        } else if (strcmp(argv[a], "--texture-cache") == 0 && a + 1 < argc) {
+            settings->textureBudget = (size_t)atol(argv[++a]) << 20;
+        } else if (strcmp(argv[a], "--regress") == 0 && a + 1 < argc) {
+            settings->regressPath = argv[++a];
+        } else if (strcmp(argv[a], "--regress-update") == 0) {
+            settings->regressUpdate = 1;
+        } else if (strcmp(argv[a], "--frame-cache") == 0 && a + 1 < argc) {
+            settings->frameCachePath = argv[++a];
+        } else if (strcmp(argv[a], "--frame-cache-mb") == 0 && a + 1 < argc) {
+            settings->frameCacheBudget = (size_t)atol(argv[++a]) << 20;
+        } else if (strcmp(argv[a], "--sampler") == 0 && a + 1 < argc) {
+            a++;
+            settings->sampler = strcmp(argv[a], "random") == 0      ? SAMPLER_RANDOM
+                                : strcmp(argv[a], "bluenoise") == 0 ? SAMPLER_BLUE_NOISE
+                                                                    : SAMPLER_SOBOL;
+        } else if (strcmp(argv[a], "--denoise") == 0) {
+            settings->denoise = 1;
+        } else if (strcmp(argv[a], "--hash") == 0) {
+            settings->frameHash = 1;
+        } else if (strcmp(argv[a], "--perf") == 0) {
+            settings->perfCounters = 1;
+        } else if (strcmp(argv[a], "--trace") == 0 && a + 1 < argc) {
+            settings->tracePath = argv[++a];
+        } else if (strcmp(argv[a], "--interactive") == 0) {
+            settings->interactive = 1;
+        } else if (strcmp(argv[a], "--stream") == 0) {
+            settings->streaming = 1;
+        } else if (strcmp(argv[a], "--heatmap") == 0 && a + 1 < argc) {
+            settings->heatmap = argv[++a];
+        } else if (strcmp(argv[a], "--cost") == 0 && a + 1 < argc) {
+            settings->costOutput = argv[++a];
+        } else if (strcmp(argv[a], "--steps") == 0 && a + 1 < argc) {
+            settings->stepsOutput = argv[++a];
+        } else if (strcmp(argv[a], "--video") == 0 && a + 1 < argc) {
+            settings->videoOutput = argv[++a];
+        } else if (strcmp(argv[a], "--video-format") == 0 && a + 1 < argc) {
+            a++;
+            settings->videoFormat = strcmp(argv[a], "rgb") == 0 ? VIDEO_RGB : VIDEO_Y4M;
+        } else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) {
+            output = argv[++a];
+        } else {
+            TraceLog(LOG_WARNING, "Ignoring unknown argument %s", argv[a]);
+        }
+    }
+    if (settings->sampling.samplesPerPass < 1) settings->sampling.samplesPerPass = 1;
+    if (output != NULL) {
+        settings->output = output;
+    } else if (settings->videoOutput != NULL) {
+        settings->output = NULL;
+    }
+}
+
+int main(int argc, char **argv) {
+    render_settings_t settings = {
+        SCREEN_WIDTH, SCREEN_HEIGHT, parallel_default_threads(), TILE_SIZE,
+        {MIN_SAMPLES, MAX_SAMPLES, SAMPLES_PER_PASS, ADAPTIVE_THRESHOLD},
+        FB_FLOAT32, "o.png", NULL, NULL, NULL, EXR_COMPRESSION_ZIP, 0,
+        1, IO_THREADS, EXPORT_QUEUE_DEPTH, NULL, VIDEO_Y4M,
+        NULL, CHECKPOINT_INTERVAL, 0, MAX_DEPTH, NULL, 0,
+        (size_t)CLUSTER_BUDGET_MB << 20, (size_t)TEXTURE_CACHE_MB << 20, NULL, NULL, 0, 0, NULL, 0,
+        NULL, (size_t)FRAME_CACHE_MB << 20, SAMPLER_SOBOL, 0
+    };
+    texture_cache_t textures;
+    scene_t scene;
+    int status = 0;
+
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "--convert") == 0) {
+        int clusterSize = argc == 5 ? atoi(argv[4]) : 0;
+        if (scene_load(&scene, argv[2], settings.clusterBudget) != 0) {
+            TraceLog(LOG_ERROR, "Could not load scene %s", argv[2]);
+            return 1;
+        }
+        if (scene.clusters != NULL) {
+            TraceLog(LOG_ERROR, "%s is already clustered", argv[2]);
+            scene_destroy(&scene);
+            return 1;
+        }
+        status = scene_write_binary(&scene, argv[3], clusterSize);
+        if (status != 0) TraceLog(LOG_ERROR, "Could not write scene %s", argv[3]);
+        scene_destroy(&scene);
+        return status == 0 ? 0 : 1;
+    }
+    parseArgs(argc, argv, &settings);
+    if (sampler_init(settings.sampler) != 0) {
+        TraceLog(LOG_WARNING, "Could not build the blue noise tile, sampling with Sobol points");
+        settings.sampler = SAMPLER_SOBOL;
+    }
+#ifdef SIGUSR1
+    signal(SIGUSR1, requestMemoryReport);
+#endif
+    if (settings.regressPath != NULL) {
+        return runRegression(&settings) == 0 ? 0 : 1;
+    }
+
+    if (settings.scenePath != NULL ? scene_load(&scene, settings.scenePath, settings.clusterBudget) != 0 : defaultScene(&scene) != 0) {
+        TraceLog(LOG_ERROR, "Could not load scene %s", settings.scenePath != NULL ? settings.scenePath : "(built in)");
+        return 1;
+    }
+    TraceLog(LOG_INFO, "Scene: %d spheres, %d materials, %d lights%s", scene.sphereCount, scene.materialCount,
+             scene.lightCount, scene.mapping != NULL ? ", mapped" : "");
+    if (scene.clusters != NULL) {
+        TraceLog(LOG_INFO, "Out-of-core: %d clusters, %d resident at most (%zu MiB budget)", scene.clusters->count,
+                 scene.clusters->slotCount, settings.clusterBudget >> 20);
+    }
+    reportAcceleration(&scene);
+
+    if (settings.videoOutput != NULL && strcmp(settings.videoOutput, "-") == 0) {
+        SetTraceLogCallback(traceToStderr);
+    }
+
+    if (texture_cache_create(&textures, settings.textureBudget) != 0) {
+        scene_destroy(&scene);
+        return 1;
+    }
+    bindTextures(&textures, &scene);
+
+    if (settings.interactive) {
+        status = renderInteractive(&settings, &scene, &textures);
+    } else if (settings.streaming) {
+        if (settings.output == NULL) {
+            TraceLog(LOG_ERROR, "Streaming needs an image output, use -o");
+            status = -1;
+        } else {
+            if (settings.heatmap != NULL || settings.costOutput != NULL || settings.stepsOutput != NULL ||
+                settings.hdrOutput != NULL || settings.frameHash || settings.denoise) {
+                TraceLog(LOG_WARNING, "Heatmap, cost, steps and HDR outputs, frame hashes and denoising need the full "
+                         "frame, ignoring them while streaming");
+            }
+            status = renderStreaming(&settings, &scene, &textures);
+            if (status != 0) TraceLog(LOG_ERROR, "Streaming render to %s failed", settings.output);
+        }
+    } else {
+        status = renderSequence(&settings, &scene, &textures);
+    }
+
+    if (settings.tracePath != NULL && profile_write_chrome(settings.tracePath) != 0) {
+        TraceLog(LOG_WARNING, "Could not write trace %s (profiling needs a build with -DEZ_PROFILE)", settings.tracePath);
+    }
+    reportMemory();
+
+    texture_cache_destroy(&textures);
+    scene_destroy(&scene);
+    return status == 0 ? 0 : 1;
+}